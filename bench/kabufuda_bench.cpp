@@ -0,0 +1,372 @@
+/*
+Copyright (c) 2022 Andreas Weis (der_ghulbus@ghulbus-inc.de)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <kabufuda.hpp>
+
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+
+#ifndef KABUFUDA_BENCH_CORPUS_DIR
+#   define KABUFUDA_BENCH_CORPUS_DIR "bench/corpus"
+#endif
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+/** Keeps the compiler from optimizing away the computation of value.
+ */
+template<typename T>
+void doNotOptimize(T const& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static char volatile sink;
+    sink = *reinterpret_cast<char const volatile*>(&value);
+#endif
+}
+
+double toMilliseconds(Clock::duration d)
+{
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+template<typename T>
+std::optional<T> parseNumber(std::string_view str)
+{
+    T ret;
+    auto const [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), ret);
+    if ((ec != std::errc{}) || (ptr != str.data() + str.size())) { return std::nullopt; }
+    return ret;
+}
+
+struct BenchOptions {
+    SolverOptions solver;
+    std::string corpus_dir = KABUFUDA_BENCH_CORPUS_DIR;
+    /// Only run microbenchmarks whose name contains this string.
+    std::string filter;
+    bool run_corpus = true;
+    bool run_micro = true;
+    /// Minimum time spent in each microbenchmark.
+    std::chrono::milliseconds min_time{ 500 };
+};
+
+/** Accumulated results of solving all deals of one corpus file.
+ */
+struct CorpusResult {
+    std::string name;
+    std::size_t deals = 0;
+    std::size_t solved = 0;
+    std::size_t unsolvable = 0;
+    std::size_t gave_up = 0;
+    std::size_t total_moves = 0;
+    Clock::duration parse_time{};
+    Clock::duration solve_time{};
+    Clock::duration replay_time{};
+    std::uint64_t nodes = 0;
+    std::uint64_t total_visited_boards = 0;
+    std::uint64_t max_visited_bytes = 0;
+};
+
+/** Solves all deals of a corpus file, timing parsing, solving, and replaying the solution separately.
+ * @param[out] sample_boards Receives the boards along all solutions found, for use by the microbenchmarks.
+ */
+std::optional<CorpusResult> runCorpusFile(std::filesystem::path const& file, Solver& solver, std::vector<Board>& sample_boards)
+{
+    auto const in = MappedFile::open(file.string().c_str());
+    if (!in) { return std::nullopt; }
+    CorpusResult ret;
+    ret.name = file.stem().string();
+    for (auto const input : splitPuzzles(in->getContents())) {
+        auto const t0 = Clock::now();
+        Board const b = parseBoard(input);
+        auto const t1 = Clock::now();
+        ret.parse_time += t1 - t0;
+        if (!b.isValid()) {
+            fmt::print(stderr, "{}: deal {} is not a valid puzzle.\n", file.string(), ret.deals + 1);
+            return std::nullopt;
+        }
+        ++ret.deals;
+
+        SolveResult const result = solver.solve(b);
+        auto const t2 = Clock::now();
+        ret.solve_time += t2 - t1;
+        ret.nodes += result.stats.nodes_expanded;
+        ret.total_visited_boards += result.stats.peak_visited_boards;
+        ret.max_visited_bytes = std::max(ret.max_visited_bytes, result.stats.peak_visited_bytes);
+        switch (result.status) {
+        case SolveStatus::Solved:       ++ret.solved; break;
+        case SolveStatus::Unsolvable:   ++ret.unsolvable; break;
+        case SolveStatus::GaveUp:       ++ret.gave_up; break;
+        }
+        ret.total_moves += result.moves.size();
+
+        auto const t3 = Clock::now();
+        Board replay = b;
+        for (auto const& m : result.moves) {
+            if (!moveIsValidForBoard(replay, m)) { break; }
+            replay.applyMove(m);
+        }
+        bool const replay_won = replay.hasWon();
+        ret.replay_time += Clock::now() - t3;
+        if ((result.status == SolveStatus::Solved) && !replay_won) {
+            fmt::print(stderr, "{}: the solution for deal {} does not win the game.\n", file.string(), ret.deals);
+            return std::nullopt;
+        }
+
+        replay = b;
+        sample_boards.push_back(replay);
+        for (auto const& m : result.moves) {
+            replay.applyMove(m);
+            sample_boards.push_back(replay);
+        }
+    }
+    return ret;
+}
+
+void printCorpusResults(std::vector<CorpusResult> const& results)
+{
+    fmt::print("{:<10} {:>5} {:>6} {:>5} {:>6} {:>9} {:>10} {:>10} {:>10} {:>11} {:>10} {:>10}\n",
+               "corpus", "deals", "solved", "unsol", "gaveup", "avg moves", "parse[us]", "solve[ms]", "replay[us]",
+               "nodes/s", "avg boards", "max [MiB]");
+    for (auto const& r : results) {
+        double const deals = static_cast<double>(std::max<std::size_t>(r.deals, 1));
+        double const solve_seconds = std::chrono::duration<double>(r.solve_time).count();
+        fmt::print("{:<10} {:>5} {:>6} {:>5} {:>6} {:>9.1f} {:>10.2f} {:>10.2f} {:>10.2f} {:>11.0f} {:>10.0f} {:>10.2f}\n",
+                   r.name, r.deals, r.solved, r.unsolvable, r.gave_up,
+                   static_cast<double>(r.total_moves) / static_cast<double>(std::max<std::size_t>(r.solved, 1)),
+                   toMilliseconds(r.parse_time) * 1000.0 / deals, toMilliseconds(r.solve_time) / deals,
+                   toMilliseconds(r.replay_time) * 1000.0 / deals,
+                   (solve_seconds > 0.0) ? (static_cast<double>(r.nodes) / solve_seconds) : 0.0,
+                   static_cast<double>(r.total_visited_boards) / deals,
+                   static_cast<double>(r.max_visited_bytes) / (1024 * 1024));
+    }
+}
+
+/** Runs a microbenchmark for at least min_time.
+ *
+ * Like Google Benchmark, the number of iterations is increased until a run takes long enough to be measured reliably.
+ * @param[in] f Invoked with the index of the iteration; performs one operation.
+ */
+void runMicroBenchmark(BenchOptions const& options, std::string_view name, std::function<void(std::size_t)> const& f)
+{
+    if (!options.filter.empty() && (name.find(options.filter) == std::string_view::npos)) { return; }
+    std::size_t iterations = 1;
+    for (;;) {
+        auto const t0 = Clock::now();
+        for (std::size_t i = 0; i < iterations; ++i) { f(i); }
+        auto const elapsed = Clock::now() - t0;
+        if ((elapsed >= options.min_time) || (iterations >= (std::size_t{ 1 } << 40))) {
+            fmt::print("{:<32} {:>12.1f} ns/op {:>14} iterations\n", name,
+                       std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(iterations), iterations);
+            return;
+        }
+        // aim for 1.5 times the minimum time, but grow by at most 10 times per step
+        double const scale = (elapsed.count() > 0) ?
+            (1.5 * std::chrono::duration<double>(options.min_time).count() / std::chrono::duration<double>(elapsed).count()) : 10.0;
+        iterations = static_cast<std::size_t>(static_cast<double>(iterations) * std::clamp(scale, 1.5, 10.0));
+    }
+}
+
+void runMicroBenchmarks(BenchOptions const& options, std::vector<Board> const& boards, std::string_view sample_input)
+{
+    // only boards that still have moves are interesting for move generation
+    std::vector<Board> open_boards;
+    std::vector<Move> first_moves;
+    for (auto const& b : boards) {
+        auto const moves = getAllValidMoves(b);
+        if (!moves.empty()) {
+            open_boards.push_back(b);
+            first_moves.push_back(moves.front());
+        }
+    }
+    if (open_boards.empty()) {
+        fmt::print(stderr, "No boards available for microbenchmarks.\n");
+        return;
+    }
+    std::size_t const n = open_boards.size();
+    fmt::print("\nMicrobenchmarks over {} boards:\n", n);
+
+    MoveBuffer moves;
+    runMicroBenchmark(options, "getAllValidMoves", [&](std::size_t i) {
+            getAllValidMoves(open_boards[i % n], moves);
+            doNotOptimize(moves);
+        });
+    runMicroBenchmark(options, "getAllValidMoves+pruneMoves", [&](std::size_t i) {
+            PruningStats pstats;
+            getAllValidMoves(open_boards[i % n], moves);
+            pruneMoves(open_boards[i % n], moves, nullptr, AllPruningRules, pstats);
+            doNotOptimize(moves);
+        });
+    runMicroBenchmark(options, "executeMove", [&](std::size_t i) {
+            Board const b = executeMove(open_boards[i % n], first_moves[i % n]);
+            doNotOptimize(b);
+        });
+    // undoMove() restores each board, so they can be modified in place
+    std::vector<Board> scratch_boards = open_boards;
+    runMicroBenchmark(options, "applyMove+undoMove", [&](std::size_t i) {
+            Board& scratch = scratch_boards[i % n];
+            MoveUndo const u = scratch.applyMove(first_moves[i % n]);
+            doNotOptimize(scratch);
+            scratch.undoMove(u);
+        });
+    runMicroBenchmark(options, "std::hash<Board>", [&](std::size_t i) {
+            doNotOptimize(std::hash<Board>{}(open_boards[i % n]));
+        });
+    runMicroBenchmark(options, "Board::getKey", [&](std::size_t i) {
+            doNotOptimize(open_boards[i % n].getKey());
+        });
+    runMicroBenchmark(options, "Board::getCanonicalKey", [&](std::size_t i) {
+            doNotOptimize(open_boards[i % n].getCanonicalKey());
+        });
+    runMicroBenchmark(options, "estimateRemainingMoves", [&](std::size_t i) {
+            doNotOptimize(estimateRemainingMoves(open_boards[i % n]));
+        });
+    runMicroBenchmark(options, "parseBoard", [&](std::size_t) {
+            doNotOptimize(parseBoard(sample_input));
+        });
+}
+
+void printUsage(char const* executable)
+{
+    fmt::print("Usage: {} [options]\n"
+               "\nOptions:\n"
+               "  --corpus=<dir>         Directory containing the deal corpus (default: {})\n"
+               "  --strategy=<s>         Search strategy used for the corpus: dfs, astar (default) or ida\n"
+               "  --weight=<w>           Heuristic weight for the astar and ida strategies (default: 2)\n"
+               "  --threads=<n>          Number of threads for the dfs strategy\n"
+               "  --canonical            Treat boards that only differ by the order of stacks and swaps as identical\n"
+               "  --timeout-ms=<n>       Give up on a deal after n milliseconds (default: 10000)\n"
+               "  --min-time-ms=<n>      Minimum time spent in each microbenchmark (default: 500)\n"
+               "  --filter=<s>           Only run microbenchmarks whose name contains s\n"
+               "  --no-corpus            Skip solving the corpus; microbenchmarks then use the initial boards only\n"
+               "  --no-micro             Skip the microbenchmarks\n",
+               executable, KABUFUDA_BENCH_CORPUS_DIR);
+}
+
+std::optional<BenchOptions> parseCommandLine(int argc, char* argv[])
+{
+    BenchOptions ret;
+    ret.solver.strategy = SearchStrategy::AStar;
+    ret.solver.time_limit = std::chrono::milliseconds(10000);
+    for (int i = 1; i < argc; ++i) {
+        std::string_view const arg = argv[i];
+        std::string_view const value = arg.substr(std::min(arg.find('='), arg.size() - 1) + 1);
+        if (arg.starts_with("--corpus=")) {
+            ret.corpus_dir = value;
+        } else if (arg == "--strategy=dfs") {
+            ret.solver.strategy = SearchStrategy::DepthFirst;
+        } else if (arg == "--strategy=astar") {
+            ret.solver.strategy = SearchStrategy::AStar;
+        } else if (arg == "--strategy=ida") {
+            ret.solver.strategy = SearchStrategy::IterativeDeepening;
+        } else if (arg.starts_with("--weight=")) {
+            auto const weight = parseNumber<double>(value);
+            if (!weight || (*weight < 1.0)) { return std::nullopt; }
+            ret.solver.heuristic_weight = *weight;
+        } else if (arg.starts_with("--threads=")) {
+            auto const threads = parseNumber<std::size_t>(value);
+            if (!threads || (*threads == 0)) { return std::nullopt; }
+            ret.solver.threads = *threads;
+        } else if (arg == "--canonical") {
+            ret.solver.canonicalize = true;
+        } else if (arg.starts_with("--timeout-ms=")) {
+            auto const ms = parseNumber<std::uint64_t>(value);
+            if (!ms) { return std::nullopt; }
+            ret.solver.time_limit = std::chrono::milliseconds(*ms);
+        } else if (arg.starts_with("--min-time-ms=")) {
+            auto const ms = parseNumber<std::uint64_t>(value);
+            if (!ms) { return std::nullopt; }
+            ret.min_time = std::chrono::milliseconds(*ms);
+        } else if (arg.starts_with("--filter=")) {
+            ret.filter = value;
+        } else if (arg == "--no-corpus") {
+            ret.run_corpus = false;
+        } else if (arg == "--no-micro") {
+            ret.run_micro = false;
+        } else {
+            return std::nullopt;
+        }
+    }
+    return ret;
+}
+}
+
+/** Benchmarks the solver on a fixed corpus of deals, followed by microbenchmarks of the building blocks of the search.
+ */
+int main(int argc, char* argv[])
+{
+    auto const options = parseCommandLine(argc, argv);
+    if (!options) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::vector<std::filesystem::path> files;
+    std::error_code ec;
+    for (auto const& entry : std::filesystem::directory_iterator(options->corpus_dir, ec)) {
+        if (entry.is_regular_file() && (entry.path().extension() == ".txt")) { files.push_back(entry.path()); }
+    }
+    if (files.empty()) {
+        fmt::print(stderr, "No deals found in corpus directory '{}'.\n", options->corpus_dir);
+        return 1;
+    }
+    // order the files by their name, so results are listed from Easy to Expert; other files come last
+    constexpr std::array<std::string_view, 4> difficulty_order = { "easy", "medium", "hard", "expert" };
+    auto const rank = [&](std::filesystem::path const& p) {
+        return std::distance(difficulty_order.begin(), std::ranges::find(difficulty_order, p.stem().string()));
+    };
+    std::ranges::sort(files, [&](auto const& lhs, auto const& rhs) {
+        return (rank(lhs) != rank(rhs)) ? (rank(lhs) < rank(rhs)) : (lhs < rhs);
+    });
+
+    std::vector<Board> sample_boards;
+    std::string sample_input;
+    if (auto const first = MappedFile::open(files.front().string().c_str()); first) {
+        auto const puzzles = splitPuzzles(first->getContents());
+        if (!puzzles.empty()) { sample_input = puzzles.front(); }
+    }
+
+    if (options->run_corpus) {
+        fmt::print("Solving corpus {}\n\n", options->corpus_dir);
+        Solver solver(options->solver);
+        std::vector<CorpusResult> results;
+        for (auto const& f : files) {
+            auto r = runCorpusFile(f, solver, sample_boards);
+            if (!r) { return 1; }
+            results.push_back(std::move(*r));
+        }
+        printCorpusResults(results);
+    } else {
+        for (auto const& f : files) {
+            auto const in = MappedFile::open(f.string().c_str());
+            if (!in) { return 1; }
+            for (auto const input : splitPuzzles(in->getContents())) { sample_boards.push_back(parseBoard(input)); }
+        }
+    }
+
+    if (options->run_micro) { runMicroBenchmarks(*options, sample_boards, sample_input); }
+    return 0;
+}
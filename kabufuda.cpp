@@ -20,545 +20,399 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
-#include <algorithm>
-#include <array>
-#include <cassert>
-#include <numeric>
-#include <ranges>
-#include <unordered_set>
-#include <unordered_map>
-#include <vector>
-
-#include <fmt/format.h>
-#include <fmt/color.h>
-
-#include <fstream>
-#include <regex>
-#include <string>
-#include <string_view>
-#include <sstream>
-#include <optional>
+#include <kabufuda.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
-
-namespace {
-template <class T>
-constexpr inline void hash_combine(std::size_t& seed, const T& v) noexcept
+#include <deque>
+#include <filesystem>
+#include <cstdio>
+#include <limits>
+#include <memory_resource>
+#include <mutex>
+#include <random>
+#include <semaphore>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#ifdef _WIN32
+#   ifndef NOMINMAX
+#       define NOMINMAX
+#   endif
+#   include <Windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+void MappedFile::unmap()
 {
-    std::hash<T> hasher;
-    seed ^= hasher(v) + 0x9e3779b9 + (seed<<6) + (seed>>2);
+#ifdef _WIN32
+    if (mapped_data) { UnmapViewOfFile(mapped_data); }
+    if (mapping_handle) { CloseHandle(mapping_handle); }
+    if (file_handle) { CloseHandle(file_handle); }
+    file_handle = nullptr;
+    mapping_handle = nullptr;
+#else
+    if (mapped_data) { munmap(const_cast<char*>(mapped_data), mapped_size); }
+#endif
+    mapped_data = nullptr;
+    mapped_size = 0;
 }
-}
-
-/** Cards are of one of the ten suits 0-9.
- */
-class Card {
-    int8_t c;
-
-public:
-    explicit Card(int8_t card)
-        :c(card)
-    {
-        assert((c >= 0) && (c < 10));
-    }
 
-    operator int8_t() const {
-        return c;
-    }
+MappedFile::~MappedFile()
+{
+    unmap();
+}
 
-    friend bool operator==(Card const&, Card const&) = default;
-    friend bool operator!=(Card const&, Card const&) = default;
-};
+MappedFile::MappedFile(MappedFile&& rhs) noexcept
+    :mapped_data(std::exchange(rhs.mapped_data, nullptr)), mapped_size(std::exchange(rhs.mapped_size, 0)),
+#ifdef _WIN32
+     file_handle(std::exchange(rhs.file_handle, nullptr)), mapping_handle(std::exchange(rhs.mapping_handle, nullptr)),
+#endif
+     buffer(std::move(rhs.buffer))
+{}
 
-namespace std
-{
-template<> struct hash<Card>
+MappedFile& MappedFile::operator=(MappedFile&& rhs) noexcept
 {
-    std::size_t operator()(Card const& c) const noexcept
-    {
-        std::size_t h = 0;
-        hash_combine(h, c);
-        return h;
+    if (this != &rhs) {
+        unmap();
+        mapped_data = std::exchange(rhs.mapped_data, nullptr);
+        mapped_size = std::exchange(rhs.mapped_size, 0);
+#ifdef _WIN32
+        file_handle = std::exchange(rhs.file_handle, nullptr);
+        mapping_handle = std::exchange(rhs.mapping_handle, nullptr);
+#endif
+        buffer = std::move(rhs.buffer);
     }
-};
+    return *this;
 }
 
-template<>
-struct fmt::formatter<Card>
+namespace {
+bool readAll(std::FILE* f, std::vector<char>& buffer)
 {
-    template<typename ParseContext>
-    constexpr auto parse(ParseContext& ctx) {
-        return ctx.begin();
-    }
-
-    template<typename FormatContext>
-    auto format(Card const& c, FormatContext& ctx) const {
-        std::array<fmt::rgb, 10> palette = {
-            fmt::rgb(0xfb, 0xef, 0xcc),
-            fmt::rgb(0xf9, 0xcc, 0xac),
-            fmt::rgb(0xf4, 0xa6, 0x88),
-            fmt::rgb(0xe0, 0x87, 0x6a),
-            fmt::rgb(0xff, 0xf2, 0xdf),
-            fmt::rgb(0xd9, 0xad, 0x7c),
-            fmt::rgb(0xa2, 0x83, 0x6e),
-            fmt::rgb(0x67, 0x4d, 0x3c),
-            fmt::rgb(0xa8, 0x8f, 0xac),
-            fmt::rgb(0x82, 0x81, 0x6d)
-        };
-
-
-        fmt::fg(fmt::color());
-        return fmt::format_to(ctx.out(), fmt::fg(palette[static_cast<int8_t>(c)]), "{}", static_cast<int>(c));
-    }
-};
-
-/** A stack of cards on the board.
- *
- * Each consists of an arbitrary number of cards stacked on top of each other.
- * Only the top cards of matching suit are accessible.
- * If a stack consists only of the four cards making up a suit, it can be collapsed.
- * Once collapsed, the stack can not be changed anymore.
- */
-class CardStack {
-    std::vector<Card> stack;
-
-    bool is_collapsed = false;
-public:
-    CardStack() = default;
-
-    CardStack(std::initializer_list<Card>&& cards)
-        :stack(cards)
-    {
-    }
-
-    Card const& getTop() const
-    {
-        return stack.back();
-    }
-
-    int getTopSize() const
-    {
-        auto rng = stack 
-            | std::ranges::views::reverse
-            | std::ranges::views::take_while([top = getTop()](Card const& c) { return c == top; });
-        return static_cast<int>(std::ranges::distance(rng));
-    }
-
-    bool isEmpty() const {
-        return stack.empty();
-    }
-
-    void pushCard(Card const& c)
-    {
-        assert(!isCollapsed());
-        stack.push_back(c);
-    }
-
-    void pushStack(Card const& c, int size)
-    {
-        assert(!isCollapsed());
-        for (int i = 0; i < size; ++i) {
-            stack.push_back(c);
-        }
+    std::array<char, 64 * 1024> chunk;
+    for (;;) {
+        std::size_t const n = std::fread(chunk.data(), 1, chunk.size(), f);
+        buffer.insert(buffer.end(), chunk.data(), chunk.data() + n);
+        if (n < chunk.size()) { return std::ferror(f) == 0; }
     }
+}
+}
 
-    void popCards(int size) {
-        assert(!isCollapsed());
-        assert(size <= getTopSize());
-        for (int i = 0; i < size; ++i) {
-            stack.pop_back();
+std::optional<MappedFile> MappedFile::open(char const* filename)
+{
+    MappedFile ret;
+#ifdef _WIN32
+    HANDLE const file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file != INVALID_HANDLE_VALUE) {
+        ret.file_handle = file;
+        LARGE_INTEGER size;
+        if ((GetFileType(file) == FILE_TYPE_DISK) && GetFileSizeEx(file, &size)) {
+            if (size.QuadPart == 0) { return ret; }
+            ret.mapping_handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (ret.mapping_handle) {
+                ret.mapped_data = static_cast<char const*>(MapViewOfFile(ret.mapping_handle, FILE_MAP_READ, 0, 0, 0));
+                if (ret.mapped_data) {
+                    ret.mapped_size = static_cast<std::size_t>(size.QuadPart);
+                    return ret;
+                }
+            }
         }
+        ret.unmap();
     }
-
-    bool isCollapsed() const {
-        return is_collapsed;
-    }
-
-    bool tryCollapse() {
-        if ((stack.size() == 4) && (getTopSize() == 4)) {
-            is_collapsed = true;
+#else
+    int const fd = ::open(filename, O_RDONLY);
+    if (fd != -1) {
+        struct stat st;
+        if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode)) {
+            if (st.st_size == 0) {
+                ::close(fd);
+                return ret;
+            }
+            void* const p = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                ::close(fd);
+                ret.mapped_data = static_cast<char const*>(p);
+                ret.mapped_size = static_cast<std::size_t>(st.st_size);
+                return ret;
+            }
         }
-        return isCollapsed();
+        ::close(fd);
     }
-
-    auto begin() const { return std::cbegin(stack); }
-    auto end() const { return std::cend(stack); }
-    auto size() const { return stack.size(); }
-
-    friend bool operator==(CardStack const&, CardStack const&) noexcept = default;
-    friend bool operator!=(CardStack const&, CardStack const&) noexcept = default;
-};
-
-/** A swap field (free cell) on the top of the playing board.
- *
- * A swap field can hold a single card, once it has been unlocked.
- * Alternativaly it can hold a stack of four cards of the same suit,
- * which will collapse the field and prevent any future changes to it.
- */
-class SwapField {
-    std::optional<Card> card;
-    enum FieldState {
-        Locked,
-        Free,
-        Occupied,
-        Collapsed
-    } state;
-public:
-    SwapField()
-        :card(), state(FieldState::Locked)
-    {}
-
-    void unlock()
-    {
-        assert(state == FieldState::Locked);
-        state = FieldState::Free;
-    }
-
-    bool isLocked() const
-    {
-        return state == FieldState::Locked;
-    }
-
-    bool isFree() const
-    {
-        return state == FieldState::Free;
+#endif
+    // not a regular file, or mapping failed; fall back to reading it
+    std::FILE* f = std::fopen(filename, "rb");
+    if (!f) {
+        fmt::print(stderr, "Unable to open input file '{}' for reading.\n", filename);
+        return std::nullopt;
     }
-
-    bool isOccupied() const
-    {
-        return state == FieldState::Occupied;
+    bool const success = readAll(f, ret.buffer);
+    std::fclose(f);
+    if (!success) {
+        fmt::print(stderr, "Unable to read input from file '{}'.\n", filename);
+        return std::nullopt;
     }
+    return ret;
+}
 
-    bool isCollapsed() const
-    {
-        return state == FieldState::Collapsed;
-    }
+MappedFile MappedFile::readStdin()
+{
+    MappedFile ret;
+    if (!readAll(stdin, ret.buffer)) { fmt::print(stderr, "Unable to read input from standard input.\n"); }
+    return ret;
+}
 
-    void pushCard(Card const& c)
-    {
-        assert(state == FieldState::Free);
-        assert(!card);
-        card = c;
-        state = FieldState::Occupied;
-    }
+Board parseBoard(std::string_view input, ParseError* error)
+{
+    auto const isSpace = [](char c) { return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\v') || (c == '\f'); };
+    auto const isDigit = [](char c) { return (c >= '0') && (c <= '9'); };
+    std::optional<ParseError> parse_error;
+    auto const fail = [&](std::size_t line, std::size_t column, std::string_view message) {
+        parse_error = ParseError{ .line = line, .column = column, .message = message };
+    };
 
-    void pushStack(Card const& c, int size)
-    {
-        if (size == 1) {
-            pushCard(c);
+    std::optional<Difficulty> difficulty;
+    std::array<std::array<Card, 8>, 5> rows;
+    std::size_t row_count = 0;
+    std::size_t line_number = 0;
+    for (std::size_t pos = 0; (pos < input.size()) && !parse_error; ) {
+        ++line_number;
+        std::size_t const eol = std::min(input.find('\n', pos), input.size());
+        std::string_view const line = input.substr(pos, eol - pos);
+        pos = eol + 1;
+
+        std::size_t i = 0;
+        auto const skipSpace = [&]() { while ((i < line.size()) && isSpace(line[i])) { ++i; } };
+        skipSpace();
+        if (i == line.size()) { continue; }
+        if (isDigit(line[i])) {
+            if (row_count == rows.size()) { fail(line_number, i + 1, "more than 5 rows of cards"); break; }
+            for (auto& card : rows[row_count]) {
+                skipSpace();
+                if (i == line.size()) { fail(line_number, i + 1, "expected 8 cards per row"); break; }
+                if (!isDigit(line[i])) { fail(line_number, i + 1, "expected a card 0-9"); break; }
+                card = Card{ static_cast<std::int8_t>(line[i] - '0') };
+                ++i;
+                if ((i < line.size()) && !isSpace(line[i])) { fail(line_number, i + 1, "expected whitespace after card"); break; }
+            }
+            ++row_count;
         } else {
-            assert(size == 4);
-            pushCard(c);
-            state = FieldState::Collapsed;
-        }
-    }
-
-    Card getCard() const
-    {
-        assert((state == FieldState::Occupied) || (state == FieldState::Collapsed));
-        return *card;
-    }
-
-    void popCard()
-    {
-        assert(state == FieldState::Occupied);
-        card = std::nullopt;
-        state = FieldState::Free;
-    }
-
-    int size() const
-    {
-        switch (state) {
-        case FieldState::Occupied: return 1;
-        case FieldState::Collapsed: return 4;
-        default: return 0;
+            std::size_t const word_end = std::min(line.find_first_of(" \t\r\v\f", i), line.size());
+            std::string_view const word = line.substr(i, word_end - i);
+            std::optional<Difficulty> d;
+            if (word == "Easy") {
+                d = Difficulty::Easy;
+            } else if (word == "Medium") {
+                d = Difficulty::Normal;
+            } else if (word == "Hard") {
+                d = Difficulty::Hard;
+            } else if (word == "Expert") {
+                d = Difficulty::Expert;
+            }
+            if (!d) { fail(line_number, i + 1, "expected a row of cards or a difficulty"); break; }
+            if (difficulty) { fail(line_number, i + 1, "difficulty given more than once"); break; }
+            difficulty = d;
+            i = word_end;
         }
+        if (parse_error) { break; }
+        skipSpace();
+        if (i != line.size()) { fail(line_number, i + 1, "unexpected characters at end of line"); }
     }
-
-    friend bool operator==(SwapField const&, SwapField const&) noexcept = default;
-    friend bool operator!=(SwapField const&, SwapField const&) noexcept = default;
-};
-
-template<>
-struct fmt::formatter<SwapField>
-{
-    template<typename ParseContext>
-    constexpr auto parse(ParseContext& ctx)
-    {
-        return ctx.begin();
+    if (!parse_error && (row_count != rows.size())) {
+        fail(std::max<std::size_t>(line_number, 1), 1, "expected 5 rows of cards");
     }
-
-    template<typename FormatContext>
-    auto format(SwapField const& s, FormatContext& ctx) const
-    {
-        if (s.isLocked()) {
-            return fmt::format_to(ctx.out(), "<X>");
-        } else if (s.isOccupied()) {
-            return fmt::format_to(ctx.out(), "<{}>", s.getCard());
-        } else if (s.isFree()) {
-            return fmt::format_to(ctx.out(), "< >");
-        } else if (s.isCollapsed()) {
-            return fmt::format_to(ctx.out(), "-{}-", s.getCard());
+    if (parse_error) {
+        if (error) {
+            *error = *parse_error;
         } else {
-            return fmt::format_to(ctx.out(), "@@@");
+            fmt::print(stderr, "Invalid board data in line {}, column {}: {}.\n",
+                       parse_error->line, parse_error->column, parse_error->message);
         }
+        return {};
     }
-};
-
-enum class Difficulty {
-    Easy,       // 4 free swaps
-    Normal,     // 3 free swaps
-    Hard,       // 2 free swaps
-    Expert      // 1 free swap
-};
-
-/** The playing board, consisting of 8 card stacks and 4 swap fields.
- */
-class Board {
-public:
-    std::array<SwapField, 4> swaps;
-    std::array<CardStack, 8> field;
-
-private:
-    static int swapIndex(int i) {
-        assert((i >= -4) && (i < 0));
-        return (-i) - 1;
-    }
-public:
 
-    Board(Difficulty d)
-    {
-        int const free_swaps = [](Difficulty d) {
-            switch (d) {
-            case Difficulty::Easy:      return 4;
-            case Difficulty::Normal:    return 3;
-            case Difficulty::Hard:      return 2;
-            default:                    return 1;
-            }
-        }(d);
-        for (int i = 0; i < free_swaps; ++i) { unlockSwap(); }
+    Board ret{ difficulty.value_or(Difficulty::Expert) };
+    for (auto const& row : rows) {
+        for (int i = 0; i < 8; ++i) { ret.field[i].pushCard(row[i]); }
     }
+    return ret;
+}
 
-    Board()
-        :Board(Difficulty::Expert)
-    {}
-
-    void unlockSwap()
-    {
-        for (int i = 0, i_end = static_cast<int>(swaps.size()); i != i_end; ++i) {
-            SwapField& swap = swaps[i];
-            if (swap.isLocked()) {
-                swap.unlock();
-                break;
-            }
+std::vector<std::string_view> splitPuzzles(std::string_view input)
+{
+    auto const isBlank = [](std::string_view l) { return l.find_first_not_of(" \t\r") == std::string_view::npos; };
+    auto const isCardLine = [](std::string_view l) { return l.find_first_of("0123456789") != std::string_view::npos; };
+    std::vector<std::string_view> ret;
+    std::size_t start = std::string_view::npos;
+    int card_lines = 0;
+    for (std::size_t pos = 0; pos < input.size(); ) {
+        std::size_t const eol = std::min(input.find('\n', pos), input.size());
+        std::string_view const line = input.substr(pos, eol - pos);
+        std::size_t const next = std::min(eol + 1, input.size());
+        if (isBlank(line)) { pos = next; continue; }
+        if (card_lines == 5) {
+            // the puzzle is complete; a line without cards is its difficulty, anything else starts the next puzzle
+            std::size_t const end = isCardLine(line) ? pos : next;
+            ret.push_back(input.substr(start, end - start));
+            start = std::string_view::npos;
+            card_lines = 0;
+            pos = end;
+            continue;
         }
+        if (start == std::string_view::npos) { start = pos; }
+        if (isCardLine(line)) { ++card_lines; }
+        pos = next;
     }
+    if (start != std::string_view::npos) { ret.push_back(input.substr(start)); }
+    return ret;
+}
 
-    bool isValid() const
-    {
-        // there should be 40 cards in total
-        int const cards_total =
-            std::accumulate(begin(field), end(field), 0, [](int acc, CardStack const& s) { return acc + static_cast<int>(s.size()); }) +
-            std::accumulate(begin(swaps), end(swaps), 0, [](int acc, SwapField const& s) { return acc + s.size(); });
-        if (cards_total != 40) { fmt::print("Invalid card total. Expected: 40. Found: {}.\n", cards_total); return false; }
-
-        // for each of the 10 suits we should have exactly 4 cards on the board
-        bool is_valid = true;
-        for (int i = 0; i < 10; ++i) {
-            Card const c = Card{ static_cast<int8_t>(i) };
-            int count = 0;
-            for (auto const& s : field) {
-                count += static_cast<int>(std::ranges::count(s, c));
-            }
-            for (auto const& s : swaps) {
-                if (s.isOccupied()) {
-                    if (c == s.getCard()) { ++count; }
-                } else if (s.isCollapsed()) {
-                    if (c == s.getCard()) { count += 4; }
-                }
-            }
-            if (count != 4) { fmt::print("Invalid count for suit {}. Expected: 4. Found: {}.\n", i, count); is_valid = false; }
-        }
-        return is_valid;
-    }
+namespace {
+/** Difficulty of an initial board, as the index into the order Easy, Medium, Hard, Expert.
+ */
+std::size_t difficultyIndex(Board const& b)
+{
+    return 4 - static_cast<std::size_t>(b.getUnlockedSwapCount());
+}
+}
 
-    bool hasWon() const
-    {
-        // we have won if there are no cards on the board that are not part of a collapsed field
-        for (auto const& s : field) {
-            if (!s.isEmpty() && !s.isCollapsed()) { return false; }
-        }
-        for (auto const& s : swaps) {
-            if (s.isOccupied()) { return false; }
+void formatPuzzleText(Board const& b, std::string& out)
+{
+    for (std::size_t row = 0; row < 5; ++row) {
+        for (std::size_t i = 0; i < b.field.size(); ++i) {
+            assert(b.field[i].size() == 5);
+            fmt::format_to(std::back_inserter(out), "{}{}", (i == 0) ? "" : " ", static_cast<int>(*(b.field[i].begin() + row)));
         }
-        return true;
-    }
-
-    int getMaxSize() const
-    {
-        auto const size_compare = [](CardStack const& s1, CardStack const& s2) { return s1.size() < s2.size(); };
-        return static_cast<int>(std::ranges::max(field, size_compare).size());
+        out.push_back('\n');
     }
+    constexpr std::array<std::string_view, 4> difficulty_names = { "Easy", "Medium", "Hard", "Expert" };
+    out.append(difficulty_names[difficultyIndex(b)]);
+    out.push_back('\n');
+}
 
-    CardStack& getField(int index)
-    {
-        assert((index >= 0) && (index < 8));
-        return field[index];
+namespace {
+/** Uniformly distributed random number in [0, bound).
+ * Unlike std::uniform_int_distribution, the result does not depend on the standard library implementation.
+ */
+std::uint64_t uniformRandom(std::mt19937_64& rng, std::uint64_t bound)
+{
+    assert(bound > 0);
+    // reject the values of the incomplete last interval, so that all remainders are equally likely
+    std::uint64_t const limit = std::numeric_limits<std::uint64_t>::max() - (std::numeric_limits<std::uint64_t>::max() % bound);
+    for (;;) {
+        std::uint64_t const r = rng();
+        if (r < limit) { return r % bound; }
     }
+}
 
-    CardStack const& getField(int index) const
-    {
-        assert((index >= 0) && (index < 8));
-        return field[index];
-    }
+/** SplitMix64 finalizer; spreads seeds that differ in few bits over the whole state of the engine.
+ */
+std::uint64_t mixSeed(std::uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+}
 
-    SwapField& getSwap(int index)
-    {
-        return swaps[swapIndex(index)];
+Board generateDeal(std::uint64_t seed, std::uint64_t index, Difficulty difficulty)
+{
+    std::mt19937_64 rng(mixSeed(seed ^ mixSeed(index)));
+    std::array<std::int8_t, 40> cards;
+    for (std::size_t i = 0; i < cards.size(); ++i) { cards[i] = static_cast<std::int8_t>(i / 4); }
+    // Fisher-Yates shuffle
+    for (std::size_t i = cards.size() - 1; i > 0; --i) {
+        std::swap(cards[i], cards[uniformRandom(rng, i + 1)]);
     }
-
-    SwapField const& getSwap(int index) const
-    {
-        return swaps[swapIndex(index)];
+    Board ret{ difficulty };
+    for (std::size_t i = 0; i < cards.size(); ++i) {
+        ret.field[i / 5].pushCard(Card{ cards[i] });
     }
+    return ret;
+}
 
-    friend bool operator==(Board const&, Board const&) noexcept = default;
-    friend bool operator!=(Board const&, Board const&) noexcept = default;
-};
-
-namespace std
-{
-template<> struct hash<Board>
+void writeBinaryHeader(std::string_view magic, std::string& out, std::uint8_t version)
 {
-    std::size_t operator()(Board const& b) const noexcept
-    {
-        std::size_t h = 0;
-        for (auto const& s : b.field) {
-            hash_combine(h, std::accumulate(s.begin(), s.end(), std::size_t{ 0 },
-                                            [](std::size_t acc, Card const& c) { return acc * 10 + c; }));
-        }
-        for (auto const& s : b.swaps) {
-            if (s.isLocked()) {
-                hash_combine(h, 11111111);
-            } else if (s.isFree()) {
-                hash_combine(h, 0);
-            } else if (s.isOccupied()) {
-                hash_combine(h, 1000 * s.getCard());
-            } else if (s.isCollapsed()) {
-                hash_combine(h, -s.getCard());
-            }
-        }
-        return h;
-    }
-};
+    assert(magic.size() == 4);
+    out.append(magic);
+    out.push_back(static_cast<char>(version));
+    out.append(3, '\0');
 }
 
-template<>
-struct fmt::formatter<Board>
+std::optional<std::string_view> getBinaryContents(std::string_view file_contents, std::string_view magic, std::uint8_t version)
 {
-    template<typename ParseContext>
-    constexpr auto parse(ParseContext& ctx)
+    if ((file_contents.size() < BinaryHeaderSize) || !file_contents.starts_with(magic) ||
+        (static_cast<std::uint8_t>(file_contents[4]) != version))
     {
-        return ctx.begin();
+        return std::nullopt;
     }
+    return file_contents.substr(BinaryHeaderSize);
+}
 
-    template<typename FormatContext>
-    auto format(Board const& b, FormatContext& ctx) const {
-        // print swaps
-        fmt::format_to(ctx.out(), "Swaps: ");
-        for (auto const& s : b.swaps) {
-            fmt::format_to(ctx.out(), "{} ", s);
-        }
-        fmt::format_to(ctx.out(), "\n");
-        // print stacks
-        int max_depth = b.getMaxSize();
-        for (int i = 0; i < max_depth; ++i) {
-            for (auto const& s : b.field) {
-                fmt::format_to(ctx.out(), " ");
-                if (i < s.size()) {
-                    if (s.isCollapsed()) {
-                        fmt::format_to(ctx.out(), "-{}-", *(s.begin() + i));
-                    } else {
-                        fmt::format_to(ctx.out(), " {} ", *(s.begin() + i));
-                    }
-                } else {
-                    fmt::format_to(ctx.out(), "   ");
-                }
-            }
-            fmt::format_to(ctx.out(), "\n");
+void encodeBinaryPuzzle(Board const& b, std::string& out)
+{
+    std::array<std::uint8_t, BinaryPuzzleRecordSize> record{};
+    std::size_t i_card = 0;
+    for (auto const& s : b.field) {
+        assert(s.size() == 5);
+        for (Card const c : s) {
+            record[i_card / 2] |= static_cast<std::uint8_t>(c << ((i_card % 2) * 4));
+            ++i_card;
         }
-        return ctx.out();
     }
-};
-
+    record.back() = static_cast<std::uint8_t>(difficultyIndex(b));
+    out.append(reinterpret_cast<char const*>(record.data()), record.size());
+}
 
-std::optional<std::string> readInputFile(char const* filename)
+Board decodeBinaryPuzzle(std::string_view record)
 {
-    std::ifstream fin(filename);
-    if (!fin) {
-        fmt::print(stderr, "Unable to open input file '{}' for reading.\n", filename);
-        return std::nullopt;
+    assert(record.size() == BinaryPuzzleRecordSize);
+    auto const difficulty = static_cast<std::uint8_t>(record.back());
+    if (difficulty > 3) { return {}; }
+    Board ret{ static_cast<Difficulty>(difficulty) };
+    for (std::size_t i_card = 0; i_card < 40; ++i_card) {
+        int const c = (static_cast<std::uint8_t>(record[i_card / 2]) >> ((i_card % 2) * 4)) & 0x0f;
+        if (c > 9) { return {}; }
+        ret.field[i_card / 5].pushCard(Card{ static_cast<std::int8_t>(c) });
     }
+    return ret;
+}
 
-    std::stringstream sstr;
-    sstr << fin.rdbuf();
-    if (!fin) {
-        fmt::print(stderr, "Unable to read input from file '{}'.\n", filename);
-        return std::nullopt;
+void encodeBinarySolution(BinarySolutionStatus status, std::vector<Move> const& moves, std::string& out)
+{
+    assert(moves.size() <= std::numeric_limits<std::uint16_t>::max());
+    out.push_back(static_cast<char>(status));
+    out.push_back(static_cast<char>(moves.size() & 0xff));
+    out.push_back(static_cast<char>(moves.size() >> 8));
+    for (auto const& m : moves) {
+        out.push_back(static_cast<char>(m.from));
+        out.push_back(static_cast<char>(m.to));
+        out.push_back(static_cast<char>(m.size));
     }
-    return sstr.str();
 }
 
-Board parseBoard(std::string_view input)
+std::size_t decodeBinarySolution(std::string_view data, BinarySolutionStatus& status, std::vector<Move>& moves)
 {
-    std::regex rx_difficulty(R"((Easy|Medium|Hard|Expert))");
-    std::match_results<std::string_view::iterator> smatch;
-    bool const has_difficulty = std::regex_search(begin(input), end(input), smatch, rx_difficulty);
-    
-    Difficulty const difficulty = [has_difficulty, &smatch]() {
-        if (has_difficulty) {
-            if (smatch[1] == "Easy") {
-                return Difficulty::Easy;
-            } else if(smatch[1] == "Medium") {
-                return Difficulty::Normal;
-            } else if(smatch[1] == "Hard") {
-                return Difficulty::Hard;
-            }
-        }
-        return Difficulty::Expert;
-    }();
-    Board ret{ difficulty };
-
-    std::regex rx_line(R"(\s*(\d)\s+(\d)\s+(\d)\s+(\d)\s+(\d)\s+(\d)\s+(\d)\s+(\d)\s*?)");
-    for (int iline = 0; iline < 5; ++iline) {
-        bool const does_match = std::regex_search(begin(input), end(input), smatch, rx_line);
-        if (!does_match) {
-            fmt::print(stderr, "Invalid board data.\n");
-            return {};
-        }
-        for (int i = 0; i < 8; ++i) {
-            auto const m = smatch[i + 1];
-            ret.field[i].pushCard(Card{ static_cast<std::int8_t>(std::stoi(m.str())) });
-        }
-        input.remove_prefix(input.length() - smatch.suffix().length());
+    if (data.size() < 3) { return 0; }
+    std::size_t const count = static_cast<std::uint8_t>(data[1]) | (static_cast<std::size_t>(static_cast<std::uint8_t>(data[2])) << 8);
+    std::size_t const record_size = 3 + count * BinaryMoveSize;
+    if (data.size() < record_size) { return 0; }
+    status = static_cast<BinarySolutionStatus>(data[0]);
+    moves.clear();
+    for (std::size_t i = 0; i < count; ++i) {
+        std::string_view const m = data.substr(3 + i * BinaryMoveSize, BinaryMoveSize);
+        moves.push_back(Move{ .from = static_cast<std::int8_t>(m[0]), .to = static_cast<std::int8_t>(m[1]),
+                              .size = static_cast<std::int8_t>(m[2]) });
     }
-
-    return ret;
+    return record_size;
 }
 
-/** A move takes 1-4 cards from one place to another.
- * The to and from fields contain an index to a card stack or swap field on the board.
- * Card Stacks are indexed left-to-right by the positive indices [0..8).
- * Swap Fields are indexed right-to-left by the negative indices [-4..-1]
- */
-struct Move {
-    int from;
-    int to;
-    int size;
-
-    friend bool operator==(Move const&, Move const&) noexcept = default;
-};
-
 bool isFieldIndex(int i)
 {
     assert((i >= -4) && (i < 8));
@@ -571,21 +425,37 @@ bool isSwapIndex(int i)
     return i < 0;
 }
 
-template<>
-struct fmt::formatter<Move>
+namespace {
+/** Checks the shape of a move between two valid slots, independent of any board.
+ */
+constexpr bool moveShapeIsValid(int from, int to, int size)
 {
-    template<typename ParseContext>
-    constexpr auto parse(ParseContext& ctx)
-    {
-        return ctx.begin();
-    }
+    // can move between 1 and 4 cards
+    if (!((size > 0) && (size < 5))) { return false; }
+    // can not move in place
+    if (from == to) { return false; }
+    // can only move 1 card from swap
+    if ((from < 0) && (size != 1)) { return false; }
+    // can only move 1 or 4 cards to swap
+    if ((to < 0) && (size != 1) && (size != 4)) { return false; }
+    return true;
+}
 
-    template<typename FormatContext>
-    auto format(Move const& m, FormatContext& ctx) const
-    {
-        return fmt::format_to(ctx.out(), "{} card{} from {} -> {}", m.size, (m.size == 1) ? "" : "s", m.from, m.to);
+/** For each move size and slot of origin, the mask of slots that can receive a move of that shape.
+ * Slot s + 4 stands for the field or swap with index s.
+ */
+constexpr auto move_shapes = []() {
+    std::array<std::array<std::uint16_t, 12>, 5> ret{};
+    for (int size = 1; size <= 4; ++size) {
+        for (int from = -4; from < 8; ++from) {
+            for (int to = -4; to < 8; ++to) {
+                if (moveShapeIsValid(from, to, size)) { ret[size][from + 4] |= static_cast<std::uint16_t>(1u << (to + 4)); }
+            }
+        }
     }
-};
+    return ret;
+}();
+}
 
 bool moveIsValid(Move const& m)
 {
@@ -594,17 +464,7 @@ bool moveIsValid(Move const& m)
     if (!fieldIsValid(m.from) || !fieldIsValid(m.to)) { return false; }
     // can move between 1 and 4 cards
     if (!((m.size > 0) && (m.size < 5))) { return false; }
-    // can not move in place
-    if (m.from == m.to) { return false; }
-    // can only move 1 card from swap
-    if (isSwapIndex(m.from)) {
-        if (m.size != 1) { return false; }
-    }
-    // can only move 1 or 4 cards to swap
-    if (isSwapIndex(m.to)) {
-        if ((m.size != 1) && (m.size != 4)) { return false; }
-    }
-    return true;
+    return (move_shapes[m.size][m.from + 4] & (1u << (m.to + 4))) != 0;
 }
 
 
@@ -618,7 +478,7 @@ bool moveIsValidForBoard(Board const& b, Move const& m)
         if (m.size != 1) { return false; }
     } else {
         // can move from stack only if enough cards are available
-        if (b.getField(m.from).size() < m.size) { return false; }
+        if (b.getField(m.from).size() < static_cast<std::size_t>(m.size)) { return false; }
     }
 
     Card const& from_card = isFieldIndex(m.from) ?
@@ -644,163 +504,2468 @@ bool moveIsValidForBoard(Board const& b, Move const& m)
     return true;
 }
 
-Board executeMove(Board b, Move const& m)
+MoveUndo Board::applyMove(Move const& m)
 {
     assert(moveIsValid(m));
-    assert(moveIsValidForBoard(b, m));
+    assert(moveIsValidForBoard(*this, m));
 
-    Card const c = isSwapIndex(m.from) ? (b.getSwap(m.from).getCard()) : (b.getField(m.from).getTop());
+    MoveUndo ret{ .move = m, .collapsed = false, .unlocked_swap = false };
+    Card const c = isSwapIndex(m.from) ? (getSwap(m.from).getCard()) : (getField(m.from).getTop());
     // remove from
     if (isSwapIndex(m.from)) {
         assert(m.size == 1);
-        b.getSwap(m.from).popCard();
+        getSwap(m.from).popCard();
     } else {
-        b.getField(m.from).popCards(m.size);
+        getField(m.from).popCards(m.size);
     }
     // push to
     if (isSwapIndex(m.to)) {
-        b.getSwap(m.to).pushStack(c, m.size);
+        getSwap(m.to).pushStack(c, m.size);
     } else {
-        CardStack& s = b.getField(m.to);
+        CardStack& s = getField(m.to);
         s.pushStack(c, m.size);
-        if (s.tryCollapse()) { b.unlockSwap(); }
+        if (s.tryCollapse()) {
+            ret.collapsed = true;
+            ret.unlocked_swap = unlockSwap();
+        }
     }
 
-    assert(b.isValid());
-    return b;
+#ifdef KABUFUDA_EXPENSIVE_CHECKS
+    // recounts all cards on the board; too slow to be done on every move of a regular debug build
+    assert(isValid());
+#endif
+    return ret;
 }
 
-std::vector<Move> getAllValidMoves(Board const& b)
+void Board::undoMove(MoveUndo const& u)
 {
-    std::vector<Move> ret;
-
-    for (int i_from = -4; i_from < 8; ++i_from) {
-        // are there cards in from slot?
-        auto const max_count = [&b](int idx) {
-            if (isSwapIndex(idx)) {
-                SwapField const& s = b.getSwap(idx);
-                return (s.isOccupied()) ? 1 : 0;
-            } else {
-                CardStack const& s = b.getField(idx);
-                if (s.isEmpty() || s.isCollapsed()) { return 0; }
-                return s.getTopSize();
-            }
-        }(i_from);
-        if (max_count == 0) { /* no cards to move in from slot */ continue; }
-        assert((max_count >= 1) && (max_count <= 4));
-        // get the from card
-        Card const c = isSwapIndex(i_from) ? b.getSwap(i_from).getCard() : b.getField(i_from).getTop();
-        // check for a matching to slot
-        for (int i_to = -4; i_to < 8; ++i_to) {
-            if (i_to == i_from) { continue; }
-            if (isSwapIndex(i_to)) {
-                // move to swap field
-                SwapField const& s = b.getSwap(i_to);
-                if (s.isFree()) {
-                    ret.push_back(Move{ .from = i_from, .to = i_to, .size = 1 });
-                    if (max_count == 4) {
-                        ret.push_back(Move{ .from = i_from, .to = i_to, .size = 4 });
-                    }
-                }
-            } else {
-                // move to swap card stack
-                CardStack const& s = b.getField(i_to);
-                if (s.isEmpty() || s.getTop() == c) {
-                    for (int i_count = 1; i_count <= max_count; ++i_count) {
-                        ret.push_back(Move{ .from = i_from, .to = i_to, .size = i_count });
-                    }
-                }
-            }
+    Move const& m = u.move;
+    // take back from to
+    Card const c = isSwapIndex(m.to) ? (getSwap(m.to).getCard()) : (getField(m.to).getTop());
+    if (isSwapIndex(m.to)) {
+        getSwap(m.to).popStack(m.size);
+    } else {
+        CardStack& s = getField(m.to);
+        if (u.collapsed) {
+            s.uncollapse();
+            if (u.unlocked_swap) { lockSwap(); }
+        }
+        s.popCards(m.size);
+    }
+    // put back to from
+    if (isSwapIndex(m.from)) {
+        getSwap(m.from).pushCard(c);
+    } else {
+        getField(m.from).pushStack(c, m.size);
+    }
+}
+
+Board executeMove(Board b, Move const& m)
+{
+    b.applyMove(m);
+    return b;
+}
+
+namespace {
+/** Bitmask summary of the slots of a board, as used by move generation.
+ *
+ * Slot s + 4 describes the field or swap with index s, so bit s + 4 of a mask stands for that slot.
+ * The destinations of a move can then be determined with a few bitwise operations
+ * instead of comparing the tops of all pairs of slots.
+ */
+struct SlotMasks {
+    /// Number of cards that can be taken from each slot.
+    std::array<std::uint8_t, 12> movable;
+    /// Suit of the movable cards of each slot; only valid where movable is non-zero.
+    std::array<std::int8_t, 12> suit;
+    /// For each suit, the field stacks showing a card of that suit on top.
+    std::array<std::uint16_t, 10> suit_tops;
+    /// Field stacks without any cards.
+    std::uint16_t empty_fields;
+    /// Unlocked swap fields without a card.
+    std::uint16_t free_swaps;
+};
+
+/** Gathers the SlotMasks for a board with the given number of unlocked swaps.
+ * The remaining swaps are locked and can neither give nor take cards, so they are not looked at.
+ */
+template<int UnlockedSwaps>
+SlotMasks getSlotMasks(Board const& b)
+{
+    SlotMasks ret{};
+    for (int i = -1; i >= -UnlockedSwaps; --i) {
+        SwapField const& s = b.getSwap(i);
+        std::size_t const slot = static_cast<std::size_t>(i + 4);
+        if (s.isFree()) {
+            ret.free_swaps |= static_cast<std::uint16_t>(1u << slot);
+        } else if (s.isOccupied()) {
+            ret.movable[slot] = 1;
+            ret.suit[slot] = s.getCard();
+        }
+    }
+    for (int i = 0; i < 8; ++i) {
+        CardStack const& s = b.getField(i);
+        std::size_t const slot = static_cast<std::size_t>(i + 4);
+        if (s.isEmpty()) {
+            ret.empty_fields |= static_cast<std::uint16_t>(1u << slot);
+        } else if (!s.isCollapsed()) {
+            Card const top = s.getTop();
+            ret.movable[slot] = static_cast<std::uint8_t>(s.getTopSize());
+            ret.suit[slot] = top;
+            ret.suit_tops[static_cast<std::size_t>(top)] |= static_cast<std::uint16_t>(1u << slot);
         }
     }
+    return ret;
+}
+
+/** Move generation for a board with the given number of unlocked swaps.
+ * Locked swaps never hold a card, so only slots from 4 - UnlockedSwaps onwards can be the origin of a move.
+ */
+template<int UnlockedSwaps>
+void getAllValidMovesImpl(Board const& b, MoveBuffer& ret)
+{
+    constexpr std::size_t first_slot = 4 - UnlockedSwaps;
+
+    // for each slot, determine which other slots could receive its cards
+    SlotMasks const masks = getSlotMasks<UnlockedSwaps>(b);
+    std::array<std::uint16_t, 12> destinations;
+    for (std::size_t slot = first_slot; slot < 12; ++slot) {
+        if (masks.movable[slot] == 0) { continue; }
+        assert(masks.movable[slot] <= 4);
+        destinations[slot] = masks.suit_tops[static_cast<std::size_t>(masks.suit[slot])] | masks.empty_fields | masks.free_swaps;
+    }
 
     // Arrange moves by putting moves with more cards first
     // Without this, traversing the search space will take very long
-    std::ranges::sort(ret, [](Move const& lhs, Move const& rhs) { return rhs.size < lhs.size; });
+    for (int i_count = 4; i_count > 0; --i_count) {
+        for (std::size_t slot = first_slot; slot < 12; ++slot) {
+            if (masks.movable[slot] < i_count) { continue; }
+            // lowest bits first, to keep the order of moves from swaps to fields
+            for (std::uint16_t to_mask = destinations[slot] & move_shapes[i_count][slot]; to_mask != 0;
+                 to_mask &= static_cast<std::uint16_t>(to_mask - 1))
+            {
+                int const i_to = std::countr_zero(to_mask) - 4;
+                ret.push_back(Move{ .from = static_cast<int>(slot) - 4, .to = i_to, .size = i_count });
+            }
+        }
+    }
+}
+}
+
+void getAllValidMoves(Board const& b, MoveBuffer& ret)
+{
+    ret.clear();
+    switch (b.getUnlockedSwapCount()) {
+    case 0: getAllValidMovesImpl<0>(b, ret); break;
+    case 1: getAllValidMovesImpl<1>(b, ret); break;
+    case 2: getAllValidMovesImpl<2>(b, ret); break;
+    case 3: getAllValidMovesImpl<3>(b, ret); break;
+    default: getAllValidMovesImpl<4>(b, ret); break;
+    }
+}
+
+std::vector<Move> getAllValidMoves(Board const& b)
+{
+    MoveBuffer buffer;
+    getAllValidMoves(b, buffer);
+    return std::vector<Move>(buffer.begin(), buffer.end());
+}
+
+void pruneMoves(Board const& b, MoveBuffer& moves, MoveUndo const* last_move, PruningRules const& rules, PruningStats& stats)
+{
+    auto const matchingRule = [&](Move const& m) -> std::optional<PruningRule> {
+        if (rules[static_cast<std::size_t>(PruningRule::RunToEmpty)]) {
+            // a full run of four collapses on the empty stack, which is real progress
+            if (isFieldIndex(m.from) && isFieldIndex(m.to) && b.getField(m.to).isEmpty() &&
+                (static_cast<std::size_t>(m.size) == b.getField(m.from).size()) && (m.size != 4))
+            {
+                return PruningRule::RunToEmpty;
+            }
+        }
+        if (rules[static_cast<std::size_t>(PruningRule::SwapToSwap)]) {
+            if (isSwapIndex(m.from) && isSwapIndex(m.to)) { return PruningRule::SwapToSwap; }
+        }
+        if (rules[static_cast<std::size_t>(PruningRule::SplitRun)]) {
+            if (isFieldIndex(m.from) && isFieldIndex(m.to) && !b.getField(m.to).isEmpty() &&
+                (m.size < b.getField(m.from).getTopSize()))
+            {
+                return PruningRule::SplitRun;
+            }
+        }
+        if (rules[static_cast<std::size_t>(PruningRule::Reversal)] && last_move && !last_move->collapsed) {
+            Move const& l = last_move->move;
+            if ((m.from == l.to) && (m.to == l.from) && (m.size == l.size)) { return PruningRule::Reversal; }
+        }
+        return std::nullopt;
+    };
+    moves.eraseIf([&](Move const& m) {
+        auto const rule = matchingRule(m);
+        if (!rule) { return false; }
+        ++stats.removed_moves[static_cast<std::size_t>(*rule)];
+        return true;
+    });
+}
+
+namespace {
+/** Static ordering key of a move; moves with larger keys are tried first.
+ * Moves that collapse a stack or swap come first. The remaining moves are ordered by the number of cards they move,
+ * and among those, moves that empty a field stack or uncover a card that can join another stack or swap come first.
+ */
+std::uint32_t getMoveOrderingKey(Board const& b, Move const& m)
+{
+    constexpr std::uint32_t collapse_key = 16;
+    std::uint32_t const size_key = static_cast<std::uint32_t>(m.size) * 2;
+    if (isSwapIndex(m.to)) {
+        return (m.size == 4) ? collapse_key : size_key;
+    }
+    CardStack const& to = b.getField(m.to);
+    if ((to.size() + static_cast<std::size_t>(m.size) == 4) && (to.isEmpty() || (to.getTopSize() == static_cast<int>(to.size())))) {
+        return collapse_key;
+    }
+    if (isSwapIndex(m.from)) { return size_key; }
+    CardStack const& from = b.getField(m.from);
+    std::size_t const remaining = from.size() - static_cast<std::size_t>(m.size);
+    if (remaining == 0) { return size_key + 1; }
+    Card const uncovered = from.begin()[remaining - 1];
+    for (int i = 0; i < 8; ++i) {
+        CardStack const& s = b.getField(i);
+        if ((i != m.from) && !s.isEmpty() && !s.isCollapsed() && (s.getTop() == uncovered)) { return size_key + 1; }
+    }
+    for (int i = -1; i >= -4; --i) {
+        SwapField const& s = b.getSwap(i);
+        if (s.isOccupied() && (s.getCard() == uncovered)) { return size_key + 1; }
+    }
+    return size_key;
+}
+
+/** Stable sort of moves by descending key.
+ * Move lists are short, so an insertion sort beats the bookkeeping of std::stable_sort.
+ */
+void sortMovesByKey(MoveBuffer& moves, std::array<std::uint32_t, MoveBuffer::Capacity>& keys)
+{
+    Move* const m = moves.begin();
+    for (std::size_t i = 1; i < moves.size(); ++i) {
+        Move const move = m[i];
+        std::uint32_t const key = keys[i];
+        std::size_t j = i;
+        for (; (j > 0) && (keys[j - 1] < key); --j) {
+            m[j] = m[j - 1];
+            keys[j] = keys[j - 1];
+        }
+        m[j] = move;
+        keys[j] = key;
+    }
+}
+}
+
+void orderMoves(Board const& b, MoveBuffer& moves, MoveOrdering ordering)
+{
+    if (ordering == MoveOrdering::Size) { return; }
+    std::array<std::uint32_t, MoveBuffer::Capacity> keys;
+    for (std::size_t i = 0; i < moves.size(); ++i) {
+        keys[i] = getMoveOrderingKey(b, moves[i]);
+    }
+    sortMovesByKey(moves, keys);
+}
+
+namespace {
+
+/** Flat open-addressing hash set of visited board keys.
+ *
+ * Keys are stored inline in a single array and collisions are resolved by linear probing
+ * within a short window. Without a memory limit the table simply grows,
+ * but once the limit is reached it starts replacing entries instead:
+ * within the probe window, the entry that was found deepest in the search
+ * gives way to a new entry found at a shallower depth.
+ * A depth-first search inserts the boards on its current path as pinned entries, which are never evicted
+ * and are always stored, even if that means growing beyond the limit because a probe window is full of them.
+ * Otherwise, a board on the path could be forgotten and reached again deeper down,
+ * and the search would run in circles.
+ * Entries are tagged with the generation they were inserted in, so that clearing the table
+ * between puzzles only has to start a new generation instead of touching all entries.
+ */
+class VisitedTable {
+    struct Entry {
+        BoardKey key;
+        std::uint32_t depth : 31;
+        /// The board is on the path of a running depth-first search and must not be evicted.
+        std::uint32_t pinned : 1;
+        /// Generation the entry was inserted in; entries of older generations are empty.
+        std::uint32_t generation;
+    };
+    static constexpr std::size_t ProbeWindow = 16;
+    static constexpr std::size_t InitialCapacity = std::size_t{ 1 } << 12;
+
+    std::vector<Entry> entries;
+    std::size_t count = 0;
+    std::size_t max_entries;
+    /// Current generation; never 0, so that value-initialized entries are empty.
+    std::uint32_t generation = 1;
+
+    bool isEmpty(Entry const& e) const {
+        return e.generation != generation;
+    }
+
+    std::size_t homeSlot(BoardKey const& key) const {
+        return std::hash<BoardKey>{}(key) & (entries.size() - 1);
+    }
+
+    bool canGrow() const {
+        return (max_entries == 0) || (entries.size() * 2 <= max_entries);
+    }
+
+    bool insertImpl(BoardKey const& key, std::uint32_t depth, bool improve, bool pin)
+    {
+        assert(!(key == BoardKey{}));
+        assert(depth < (1u << 31));
+        if ((count + 1 > entries.size() / 4 * 3) && canGrow()) { grow(); }
+        for (;;) {
+            std::size_t const mask = entries.size() - 1;
+            std::size_t const home = homeSlot(key);
+            std::size_t const window = std::min(ProbeWindow, entries.size());
+            std::optional<std::size_t> victim;
+            for (std::size_t i = 0; i < window; ++i) {
+                std::size_t const slot = (home + i) & mask;
+                Entry& e = entries[slot];
+                if (isEmpty(e)) {
+                    e = Entry{ .key = key, .depth = depth, .pinned = pin, .generation = generation };
+                    ++count;
+                    return true;
+                }
+                if (e.key == key) {
+                    if (improve && (depth < e.depth)) {
+                        e.depth = depth;
+                        return true;
+                    }
+                    return false;
+                }
+                if (!e.pinned && (!victim || (e.depth > entries[*victim].depth))) { victim = slot; }
+            }
+            if (canGrow() || (pin && !victim)) {
+                // probe window is full; make room and try again
+                grow();
+                continue;
+            }
+            if (victim && (pin || (entries[*victim].depth > depth))) {
+                entries[*victim] = Entry{ .key = key, .depth = depth, .pinned = pin, .generation = generation };
+            }
+            return true;
+        }
+    }
+
+    void grow()
+    {
+        std::vector<Entry> old_entries(entries.size() * 2);
+        std::swap(old_entries, entries);
+        count = 0;
+        std::uint32_t const old_generation = generation;
+        generation = 1;
+        for (auto const& e : old_entries) {
+            if (e.generation == old_generation) { insertImpl(e.key, e.depth, false, e.pinned); }
+        }
+    }
+
+public:
+    /** Constructs an empty table.
+     * @param[in] max_bytes Upper limit for the memory used by the table. 0 means unlimited.
+     */
+    explicit VisitedTable(std::size_t max_bytes = 0)
+        :max_entries(std::bit_floor(max_bytes / sizeof(Entry)))
+    {
+        if ((max_bytes != 0) && (max_entries == 0)) { max_entries = 1; }
+        entries.resize((max_entries == 0) ? InitialCapacity : std::min(InitialCapacity, max_entries));
+    }
+
+    /** Inserts a key that was found at the given search depth.
+     * @return false if the key was already in the table, true otherwise.
+     *         A return value of true does not guarantee that the key was stored,
+     *         as a full table may decide to drop it.
+     */
+    bool insert(BoardKey const& key, std::uint32_t depth)
+    {
+        return insertImpl(key, depth, false, false);
+    }
+
+    /** Inserts a key for a board on the path of a depth-first search.
+     * If the key was not in the table yet, it is always stored and can not be evicted until it is unpinned.
+     * @return false if the key was already in the table, true otherwise.
+     */
+    bool insertPinned(BoardKey const& key, std::uint32_t depth)
+    {
+        return insertImpl(key, depth, false, true);
+    }
+
+    /** Allows evicting a key inserted by insertPinned() again, once its board has left the search path.
+     */
+    void unpin(BoardKey const& key)
+    {
+        if (!isBounded()) { return; }
+        std::size_t const mask = entries.size() - 1;
+        std::size_t const home = homeSlot(key);
+        std::size_t const window = std::min(ProbeWindow, entries.size());
+        for (std::size_t i = 0; i < window; ++i) {
+            Entry& e = entries[(home + i) & mask];
+            if (isEmpty(e)) { break; }
+            if (e.key == key) {
+                e.pinned = 0;
+                return;
+            }
+        }
+    }
+
+    /** Tests whether the table evicts entries once it is full.
+     * Unbounded tables never evict anything, so pinning makes no difference for them.
+     */
+    bool isBounded() const {
+        return max_entries != 0;
+    }
+
+    /** Inserts a key, or lowers the depth stored for it if it is already in the table.
+     * @return false if the key was already in the table with a depth not greater than depth, true otherwise.
+     */
+    bool insertOrImprove(BoardKey const& key, std::uint32_t depth)
+    {
+        return insertImpl(key, depth, true, false);
+    }
+
+    /** Retrieves the depth stored for a key, if it is in the table.
+     */
+    std::optional<std::uint32_t> find(BoardKey const& key) const
+    {
+        std::size_t const mask = entries.size() - 1;
+        std::size_t const home = homeSlot(key);
+        std::size_t const window = std::min(ProbeWindow, entries.size());
+        for (std::size_t i = 0; i < window; ++i) {
+            Entry const& e = entries[(home + i) & mask];
+            if (isEmpty(e)) { break; }
+            if (e.key == key) { return e.depth; }
+        }
+        return std::nullopt;
+    }
+
+    std::size_t size() const {
+        return count;
+    }
+
+    std::size_t memoryUsage() const {
+        return entries.size() * sizeof(Entry);
+    }
+
+    /** Removes all keys from the table without releasing its memory.
+     */
+    void clear()
+    {
+        count = 0;
+        if (++generation == 0) {
+            // wrapped around; entries of the previous generation 1 would come back to life
+            std::ranges::fill(entries, Entry{});
+            generation = 1;
+        }
+    }
+};
+
+}
 
+int estimateRemainingMoves(Board const& b)
+{
+    std::array<int, 10> groups{};
+    for (auto const& s : b.field) {
+        if (s.isCollapsed()) { continue; }
+        std::optional<Card> previous;
+        for (auto const& c : s) {
+            if (c != previous) { ++groups[c]; }
+            previous = c;
+        }
+    }
+    for (auto const& s : b.swaps) {
+        if (s.isOccupied()) { ++groups[s.getCard()]; }
+    }
+    int ret = 0;
+    for (int const n : groups) {
+        if (n > 0) { ret += std::max(1, n - 1); }
+    }
     return ret;
 }
 
-std::vector<Move> solve(Board b)
+int countFreeSwaps(Board const& b)
+{
+    return static_cast<int>(std::ranges::count_if(b.swaps, [](SwapField const& s) { return s.isFree(); }));
+}
+
+bool isDeadEnd(Board const& b)
+{
+    if (countFreeSwaps(b) != 0) { return false; }
+    if (std::ranges::any_of(b.field, [](CardStack const& s) { return s.isEmpty(); })) { return false; }
+
+    // Each slot is dug down from the top as far as runs could possibly be moved away from it.
+    // Slots 0-7 are the field stacks; slots 8-11 the swaps, which offer a single card.
+    std::array<int, 12> remaining{};
+    std::array<Card const*, 12> cards{};
+    std::array<Card, 4> swap_cards{};
+    std::array<int, 12> top_run{};
+    // per suit: number of slots showing the suit, and number of cards on top or dug out
+    std::array<int, 10> showing{};
+    std::array<int, 10> reachable{};
+    std::array<bool, 10> has_sink{};
+    auto const top = [&](std::size_t i) { return static_cast<std::size_t>(cards[i][remaining[i] - 1]); };
+    auto const uncover = [&](std::size_t i, int run) {
+        showing[top(i)] += 1;
+        reachable[top(i)] += run;
+        top_run[i] = run;
+    };
+    auto const uncoverRun = [&](std::size_t i) {
+        int run = 1;
+        while ((run < remaining[i]) && (cards[i][remaining[i] - 1 - run] == cards[i][remaining[i] - 1])) { ++run; }
+        uncover(i, run);
+    };
+    bool any_cards = false;
+    for (std::size_t i = 0; i < 8; ++i) {
+        CardStack const& s = b.field[i];
+        if (s.isCollapsed()) { continue; }
+        cards[i] = s.begin();
+        remaining[i] = static_cast<int>(s.size());
+        uncover(i, s.getTopSize());
+        any_cards = true;
+    }
+    for (std::size_t i = 0; i < 4; ++i) {
+        SwapField const& s = b.swaps[i];
+        if (!s.isOccupied()) { continue; }
+        swap_cards[i] = s.getCard();
+        cards[8 + i] = &swap_cards[i];
+        remaining[8 + i] = 1;
+        uncover(8 + i, 1);
+        any_cards = true;
+    }
+    if (!any_cards) { /* won */ return false; }
+
+    for (bool dug = true; dug;) {
+        dug = false;
+        // all four cards of a suit within reach might be collapsed
+        if (std::ranges::any_of(reachable, [](int n) { return n == 4; })) { return false; }
+        for (std::size_t i = 0; i < 12; ++i) {
+            if (remaining[i] == 0) { continue; }
+            std::size_t const t = top(i);
+            if ((showing[t] < 2) && !has_sink[t]) { continue; }
+            // the run could be put onto another run of its suit
+            --showing[t];
+            has_sink[t] = true;
+            remaining[i] -= top_run[i];
+            // freeing a stack or swap opens up other moves
+            if (remaining[i] == 0) { return false; }
+            uncoverRun(i);
+            dug = true;
+        }
+    }
+    return true;
+}
+
+namespace {
+
+/// Keeps rarely taken paths out of the search loops, where inlining them costs more than the call.
+#if defined(_MSC_VER)
+#define KABUFUDA_NOINLINE __declspec(noinline)
+#else
+#define KABUFUDA_NOINLINE __attribute__((noinline))
+#endif
+
+/// Size of the transposition cache used by SearchStrategy::IterativeDeepening if no memory limit was given.
+constexpr std::size_t DefaultTranspositionCacheBytes = std::size_t{ 16 } << 20;
+/// Memory for the visited set, nodes and open list of SearchStrategy::AStar if no memory limit was given.
+constexpr std::size_t DefaultAStarStorageBytes = std::size_t{ 1 } << 30;
+
+/** Checks a board reached by the move m for a dead end, if enabled by the options.
+ * Only boards where m used up a free swap or an empty stack are examined: other moves onto a board
+ * without free space start from a board without free space that was not a dead end,
+ * and examining all of them costs more search time than it saves.
+ */
+KABUFUDA_NOINLINE bool isDeadEndAfter(Board const& b, Move const& m, SolverOptions const& options)
+{
+    if (!options.detect_dead_ends) { return false; }
+    bool const filled_space = isSwapIndex(m.to) || (b.getField(m.to).size() == static_cast<std::size_t>(m.size));
+    return filled_space && isDeadEnd(b);
+}
+
+/** Looks up a board reached by the move m in the endgame table, if the options have one.
+ * Only boards where m collapsed a stack are looked up, as no other move changes whether the table covers a board.
+ * @return The distance to a win, EndgameTable::Lost, or std::nullopt if the table does not cover the board.
+ */
+KABUFUDA_NOINLINE std::optional<int> probeEndgameAfter(Board const& b, Move const& m, SolverOptions const& options)
+{
+    if (!options.endgame) { return std::nullopt; }
+    bool const collapsed = isSwapIndex(m.to) ? b.getSwap(m.to).isCollapsed() : b.getField(m.to).isCollapsed();
+    return collapsed ? options.endgame->getDistance(b) : std::nullopt;
+}
+
+/** Plays the moves from the endgame table that win from b, recording them on the move stack.
+ * @return false if the table has no winning moves for b; b is unchanged in that case.
+ */
+bool playEndgame(Board& b, EndgameTable const& endgame, std::vector<MoveUndo>& move_stack)
+{
+    auto const moves = endgame.getWinningMoves(b);
+    if (!moves) { return false; }
+    for (auto const& m : *moves) { move_stack.push_back(b.applyMove(m)); }
+    return true;
+}
+
+/** Takes the sizes of a visited set into account for the peak values of stats.
+ */
+template<typename VisitedSet>
+void updateVisitedStats(SearchStats& stats, VisitedSet& boards)
+{
+    stats.peak_visited_boards = std::max<std::uint64_t>(stats.peak_visited_boards, boards.size());
+    stats.peak_visited_bytes = std::max<std::uint64_t>(stats.peak_visited_bytes, boards.memoryUsage());
+}
+
+/** Watches over a running search.
+ *
+ * Invokes the progress callback and checks the limits of the solver options.
+ * Searches call check() about every CheckInterval nodes, so the clock is not queried for every node,
+ * and limits may be exceeded by that many nodes before the search stops.
+ */
+class SearchMonitor {
+    SolverOptions const& options;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point next_report;
+    SearchLimit exceeded_limit = SearchLimit::None;
+public:
+    static constexpr std::uint64_t CheckInterval = 1024;
+
+    explicit SearchMonitor(SolverOptions const& opts)
+        :options(opts), start(std::chrono::steady_clock::now()), next_report(start + opts.progress_interval)
+    {}
+
+    /** Checks whether check() needs to be called at all.
+     */
+    bool isActive() const {
+        return options.progress || (options.time_limit.count() != 0) || (options.max_nodes != 0) || (options.max_memory_bytes != 0);
+    }
+
+    /** Reports progress if it is due and checks the limits.
+     * @param[in,out] stats Statistics of the search so far. The elapsed time and the visited set peaks are updated.
+     * @param[in] boards The visited set of the search.
+     * @param[in] storage_bytes Memory used by the search in addition to the visited set.
+     * @return false if the search has to give up.
+     */
+    template<typename VisitedSet>
+    bool check(SearchStats& stats, VisitedSet& boards, std::size_t storage_bytes)
+    {
+        if (!isActive()) { return true; }
+        auto const now = std::chrono::steady_clock::now();
+        stats.elapsed = now - start;
+        std::size_t const visited_bytes = boards.memoryUsage();
+        stats.peak_visited_boards = std::max<std::uint64_t>(stats.peak_visited_boards, boards.size());
+        stats.peak_visited_bytes = std::max<std::uint64_t>(stats.peak_visited_bytes, visited_bytes);
+        if (options.progress && (now >= next_report)) {
+            next_report = now + options.progress_interval;
+            options.progress(stats);
+        }
+        if ((options.max_nodes != 0) && (stats.nodes_expanded >= options.max_nodes)) {
+            exceeded_limit = SearchLimit::Nodes;
+        } else if ((options.time_limit.count() != 0) && (stats.elapsed >= options.time_limit)) {
+            exceeded_limit = SearchLimit::Time;
+        } else if ((options.max_memory_bytes != 0) && (visited_bytes + storage_bytes > options.max_memory_bytes)) {
+            exceeded_limit = SearchLimit::Memory;
+        }
+        return exceeded_limit == SearchLimit::None;
+    }
+
+    SearchLimit getExceededLimit() const {
+        return exceeded_limit;
+    }
+
+    /** Records that the search gave up because of a limit that it checks by itself.
+     */
+    void giveUp(SearchLimit limit) {
+        exceeded_limit = limit;
+    }
+};
+
+/** Move ordering state that a depth-first search learns as it goes, for MoveOrdering::History.
+ *
+ * Whenever a move collapses a suit, the moves leading up to it are credited in a history table
+ * indexed by source and destination slot. Moves with the same getMoveOrderingKey() are then
+ * tried in order of their history score, and otherwise in the order they were generated.
+ */
+class MoveHistory {
+    /// Number of moves before a collapse that are credited for it, including the collapsing move.
+    static constexpr std::size_t CreditedMoves = 4;
+    static constexpr std::uint32_t MaxScore = (1u << 20) - 1;
+
+    std::array<std::uint32_t, 12 * 12> scores{};
+
+    static std::size_t getIndex(Move const& m) {
+        return static_cast<std::size_t>(m.from + 4) * 12 + static_cast<std::size_t>(m.to + 4);
+    }
+
+    void credit(Move const& m, std::uint32_t amount) {
+        std::uint32_t& score = scores[getIndex(m)];
+        score += amount;
+        if (score > MaxScore) {
+            // age all entries, so that recent experience outweighs old one
+            for (auto& s : scores) { s /= 2; }
+        }
+    }
+public:
+    void clear() {
+        scores.fill(0);
+    }
+
+    /** Credits the moves on the search path for the collapse made by its last move.
+     * Moves closer to the collapse receive more credit.
+     */
+    void recordCollapse(std::vector<MoveUndo> const& move_stack) {
+        std::size_t const end = move_stack.size();
+        std::size_t const first = (end > CreditedMoves) ? (end - CreditedMoves) : 0;
+        for (std::size_t i = first; i < end; ++i) {
+            credit(move_stack[i].move, static_cast<std::uint32_t>(i - first + 1));
+        }
+    }
+
+    /** Credits all moves of a solution.
+     */
+    void recordSolution(std::vector<MoveUndo> const& move_stack) {
+        for (auto const& u : move_stack) { credit(u.move, 1); }
+    }
+
+    void orderMoves(Board const& b, MoveBuffer& moves, MoveOrdering ordering) const {
+        if (ordering != MoveOrdering::History) { return ::orderMoves(b, moves, ordering); }
+        std::array<std::uint32_t, MoveBuffer::Capacity> keys;
+        for (std::size_t i = 0; i < moves.size(); ++i) {
+            keys[i] = (getMoveOrderingKey(b, moves[i]) << 20) | scores[getIndex(moves[i])];
+        }
+        sortMovesByKey(moves, keys);
+    }
+};
+
+/** One level of a depth-first search: the moves available at that level, and how many of them were tried already.
+ */
+struct DepthFirstFrame {
+    MoveBuffer valid_moves;
+    std::size_t current_move = 0;
+};
+
+/** Depth-first search using make/unmake moves, favoring moves that move many cards at once.
+ * @param[in,out] b The board to start from. If a solution is found, b is left at the winning board.
+ * @param[in] last_move The move that led to b, if any.
+ * @param[in] base_depth Depth of b in the overall search; used for inserting into the visited set.
+ * @param[in,out] boards Set of visited boards, providing insertPinned(), unpin() and isBounded() like VisitedTable.
+ * @param[in,out] stats Receives the counters for the search.
+ * @param[in,out] frames Storage for the search frames. Frames are never released,
+ *                       so their move buffers can be reused between searches.
+ * @param[out] move_stack If a solution is found, the moves leading from b to the winning board.
+ * @param[in,out] history Move ordering state, updated with the collapses found by the search.
+ * @param[in] on_node Invoked with the current depth before each move is tried.
+ *                    Returning false aborts the search.
+ * @return true if a solution was found.
+ */
+template<typename VisitedSet, typename NodeCallback>
+bool searchDepthFirst(Board& b, MoveUndo const* last_move, std::uint32_t base_depth, VisitedSet& boards,
+                      SolverOptions const& options, SearchStats& stats,
+                      std::vector<DepthFirstFrame>& frames, std::vector<MoveUndo>& move_stack,
+                      MoveHistory& history, NodeCallback&& on_node)
 {
-    if (b.hasWon()) { return {}; }
-    struct State {
-        Board b;
-        std::vector<Move> valid_moves;
-        std::size_t current_move = 0;
+    auto const keyOf = [&options](Board const& board) {
+        return options.canonicalize ? board.getCanonicalKey() : board.getKey();
+    };
+    // boards on the path are pinned in the visited set, so that a bounded set can not forget them
+    auto const unpin = [&]() {
+        if (boards.isBounded()) { boards.unpin(keyOf(b)); }
     };
-    std::vector<State> stack;
-    std::vector<Move> move_stack;
-    std::unordered_set<Board> boards;
-
-    // traverse the search space in a depth-first manner, favoring moves that move many cards at once
-    stack.push_back(State{ .b = b, .valid_moves = getAllValidMoves(b) });
-    while (!stack.empty()) {
-        auto const& [board, moves, current_move] = stack.back();
-        if (current_move == moves.size()) {
+    std::size_t depth = 0;
+    move_stack.clear();
+    if (frames.empty()) { frames.emplace_back(); }
+    frames[0].current_move = 0;
+    getAllValidMoves(b, frames[0].valid_moves);
+    ++stats.nodes_expanded;
+    stats.moves_generated += frames[0].valid_moves.size();
+    pruneMoves(b, frames[0].valid_moves, last_move, options.pruning, stats.pruning);
+    history.orderMoves(b, frames[0].valid_moves, options.move_ordering);
+    for (;;) {
+        if (!on_node(depth)) { break; }
+        DepthFirstFrame& frame = frames[depth];
+        if (frame.current_move >= frame.valid_moves.size()) {
             // no more moves at this level; backtrack
-            stack.pop_back();
+            if (depth == 0) { break; }
+            --depth;
+            unpin();
+            b.undoMove(move_stack.back());
             move_stack.pop_back();
             continue;
-        } else {
-            auto const& m = moves[current_move];
-            ++stack.back().current_move;
-            Board const new_board = executeMove(board, m);
-            if (boards.contains(new_board)) { continue; }
-            boards.insert(new_board);
-            move_stack.push_back(m);
-            if (new_board.hasWon()) { fmt::print("!!! We have a winner !!!\n"); break; }
-            stack.push_back(State{ .b = new_board, .valid_moves = getAllValidMoves(new_board) });
         }
+        Move const m = frame.valid_moves[frame.current_move];
+        ++frame.current_move;
+        MoveUndo const undo = b.applyMove(m);
+        if (!boards.insertPinned(keyOf(b), base_depth + static_cast<std::uint32_t>(depth + 1))) {
+            ++stats.duplicates;
+            b.undoMove(undo);
+            continue;
+        }
+        if (isDeadEndAfter(b, m, options)) {
+            ++stats.dead_ends;
+            unpin();
+            b.undoMove(undo);
+            continue;
+        }
+        std::optional<int> const distance = probeEndgameAfter(b, m, options);
+        if (distance) { ++stats.endgame_hits; }
+        if (distance == EndgameTable::Lost) {
+            unpin();
+            b.undoMove(undo);
+            continue;
+        }
+        move_stack.push_back(undo);
+        if (undo.collapsed) { history.recordCollapse(move_stack); }
+        stats.peak_depth = std::max<std::uint64_t>(stats.peak_depth, base_depth + depth + 1);
+        if (b.hasWon() || (distance && playEndgame(b, *options.endgame, move_stack))) { return true; }
+        ++depth;
+        if (depth == frames.size()) { frames.emplace_back(); }
+        frames[depth].current_move = 0;
+        getAllValidMoves(b, frames[depth].valid_moves);
+        ++stats.nodes_expanded;
+        stats.moves_generated += frames[depth].valid_moves.size();
+        pruneMoves(b, frames[depth].valid_moves, &move_stack.back(), options.pruning, stats.pruning);
+        history.orderMoves(b, frames[depth].valid_moves, options.move_ordering);
     }
-
-    return move_stack;
+    // restore the initial board
+    while (!move_stack.empty()) {
+        unpin();
+        b.undoMove(move_stack.back());
+        move_stack.pop_back();
+    }
+    return false;
 }
 
-int main(int argc, char* argv[])
-{
-    fmt::print("*** KABUFUDA SOLITAIRE ***\n");
+/** Visited set that can be shared between threads.
+ *
+ * Keys are distributed over a number of independently locked VisitedTables,
+ * so that threads rarely compete for the same lock.
+ */
+class ShardedVisitedTable {
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        VisitedTable table;
+
+        explicit Shard(std::size_t max_bytes)
+            :table(max_bytes)
+        {}
+    };
+    std::vector<std::unique_ptr<Shard>> shards;
+    bool bounded;
+
+    Shard& shardFor(BoardKey const& key) {
+        // the low bits of the hash select the slot within a table, so use the high bits for selecting the shard
+        std::uint64_t const h = std::hash<BoardKey>{}(key);
+        return *shards[(h >> 40) % shards.size()];
+    }
 
-    if (argc != 2) {
-        fmt::print("\nUsage: {} <input_file.txt>\n", argv[0]);
-        return 0;
+public:
+    /** Constructs an empty table.
+     * @param[in] shard_count Number of independently locked tables.
+     * @param[in] max_bytes Upper limit for the memory used by all shards together. 0 means unlimited.
+     */
+    ShardedVisitedTable(std::size_t shard_count, std::size_t max_bytes)
+        :bounded(max_bytes != 0)
+    {
+        assert(shard_count > 0);
+        for (std::size_t i = 0; i < shard_count; ++i) {
+            shards.push_back(std::make_unique<Shard>(max_bytes / shard_count));
+        }
     }
 
-    auto const in = readInputFile(argv[1]);
-    if (!in) {
-        fmt::print("Error reading input file {}\n", argv[1]);
-        return 1;
+    /** Inserts a key that was found at the given search depth.
+     * @see VisitedTable::insert()
+     */
+    bool insert(BoardKey const& key, std::uint32_t depth)
+    {
+        Shard& s = shardFor(key);
+        std::scoped_lock lk(s.mutex);
+        return s.table.insert(key, depth);
     }
-    Board const b = parseBoard(*in);
-    if (!b.isValid()) {
-        fmt::print("Input file {} does not contain a valid puzzle input.\n"
-                   "\nHere's what I got from that file:\n{}\n", argv[1], b);
-        return 1;
+
+    /** Inserts a key for a board on the path of one of the searching threads.
+     * @see VisitedTable::insertPinned()
+     */
+    bool insertPinned(BoardKey const& key, std::uint32_t depth)
+    {
+        Shard& s = shardFor(key);
+        std::scoped_lock lk(s.mutex);
+        return s.table.insertPinned(key, depth);
     }
 
-    fmt::print("Puzzle input:\n{}\n", b);
+    void unpin(BoardKey const& key)
+    {
+        if (!isBounded()) { return; }
+        Shard& s = shardFor(key);
+        std::scoped_lock lk(s.mutex);
+        s.table.unpin(key);
+    }
 
-    auto const t0 = std::chrono::steady_clock::now();
-    auto const moves = solve(b);
-    auto const t1 = std::chrono::steady_clock::now();
+    bool isBounded() const {
+        return bounded;
+    }
 
-    if (moves.empty()) {
-        fmt::print("Could not find a solution. :(\n");
-    } else {
-        fmt::print("*** Winning Moves: ***\n");
-        for (auto const m : moves) {
-            fmt::print(" - {}\n", m);
+    std::size_t size()
+    {
+        std::size_t ret = 0;
+        for (auto& s : shards) {
+            std::scoped_lock lk(s->mutex);
+            ret += s->table.size();
         }
-        Board b2 = b;
-        fmt::print("Board:\n{}\n", b2);
-        for (auto const m : moves) {
-            b2 = executeMove(b2, m);
-            fmt::print("Moving {}:\n{}\n", m, b2);
+        return ret;
+    }
+
+    std::size_t memoryUsage()
+    {
+        std::size_t ret = 0;
+        for (auto& s : shards) {
+            std::scoped_lock lk(s->mutex);
+            ret += s->table.memoryUsage();
         }
+        return ret;
     }
+};
 
-    fmt::print("\nSolving the puzzle took {} ms.\n",
-               std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count());
+/** Depth-first search distributed over multiple threads.
+ *
+ * The first few plies are expanded breadth-first to create one task per subtree,
+ * which are then distributed over the per-thread work queues.
+ * Threads take tasks from the back of their own queue and steal from the front of other threads' queues
+ * once they run dry. A thread that notices idle threads while its own queue is empty splits off
+ * the untried moves closest to the root of its current subtree into new tasks for others to steal.
+ * All threads share a single visited set, and stop as soon as one of them finds a solution.
+ */
+class ParallelDepthFirstSearch {
+    /// A board whose key has been inserted into the visited set, but which has not been expanded yet.
+    struct Task {
+        Board board;
+        std::pmr::vector<Move> path;
+        std::optional<MoveUndo> last_move;
+    };
+    struct alignas(64) WorkQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
 
-    return 0;
+    SolverOptions const& options;
+    /// Storage for the paths of tasks, which are created by one worker and often destroyed by another.
+    std::pmr::synchronized_pool_resource task_memory;
+    ShardedVisitedTable boards;
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    /// Number of tasks that have been created, but not yet processed completely.
+    std::atomic<std::size_t> pending_tasks = 0;
+    std::atomic<int> idle_workers = 0;
+    /// Released once for each new task, and once for every worker when the search ends, to wake up idle workers.
+    std::counting_semaphore<> work_available{ 0 };
+    std::atomic<bool> done = false;
+    std::mutex result_mutex;
+    std::optional<std::vector<Move>> result;
+    /// Counters of each worker that have not been added to total_stats yet.
+    std::vector<SearchStats> worker_stats;
+    std::mutex stats_mutex;
+    SearchStats total_stats;
+    SearchMonitor& monitor;
+
+    static constexpr std::size_t SplitCheckInterval = 256;
+
+    BoardKey keyFor(Board const& board) const {
+        return options.canonicalize ? board.getCanonicalKey() : board.getKey();
+    }
+
+    void flushStats(std::size_t worker)
+    {
+        std::scoped_lock lk(stats_mutex);
+        total_stats.merge(worker_stats[worker]);
+        worker_stats[worker] = SearchStats{};
+        if (!monitor.check(total_stats, boards, 0)) { stop(); }
+    }
+
+    template<typename MoveRange>
+    void reportSolution(MoveRange const& moves)
+    {
+        std::scoped_lock lk(result_mutex);
+        if (!result) { result.emplace(std::ranges::begin(moves), std::ranges::end(moves)); }
+        stop();
+    }
+
+    void wakeAllWorkers()
+    {
+        work_available.release(static_cast<std::ptrdiff_t>(queues.size()));
+    }
+
+    void stop()
+    {
+        done = true;
+        wakeAllWorkers();
+    }
+
+    void pushTask(std::size_t queue_index, Task&& t)
+    {
+        ++pending_tasks;
+        WorkQueue& q = *queues[queue_index];
+        {
+            std::scoped_lock lk(q.mutex);
+            q.tasks.push_back(std::move(t));
+        }
+        work_available.release();
+    }
+
+    std::optional<Task> popTask(std::size_t worker)
+    {
+        {
+            WorkQueue& q = *queues[worker];
+            std::scoped_lock lk(q.mutex);
+            if (!q.tasks.empty()) {
+                Task t = std::move(q.tasks.back());
+                q.tasks.pop_back();
+                return t;
+            }
+        }
+        // steal the task closest to the root from someone else
+        for (std::size_t i = 1; i < queues.size(); ++i) {
+            WorkQueue& q = *queues[(worker + i) % queues.size()];
+            std::scoped_lock lk(q.mutex);
+            if (!q.tasks.empty()) {
+                Task t = std::move(q.tasks.front());
+                q.tasks.pop_front();
+                return t;
+            }
+        }
+        return std::nullopt;
+    }
+
+    bool hasQueuedTasks(std::size_t worker)
+    {
+        WorkQueue& q = *queues[worker];
+        std::scoped_lock lk(q.mutex);
+        return !q.tasks.empty();
+    }
+
+    /** Moves all untried moves from the frame closest to the root into new tasks on the worker's queue.
+     */
+    void splitWork(std::size_t worker, Task const& task, Board const& b,
+                   std::vector<DepthFirstFrame>& frames, std::vector<MoveUndo> const& move_stack, std::size_t depth)
+    {
+        std::size_t split_depth = 0;
+        while ((split_depth <= depth) && (frames[split_depth].current_move >= frames[split_depth].valid_moves.size())) {
+            ++split_depth;
+        }
+        if (split_depth > depth) { return; }
+        // reconstruct the board at the split depth
+        Board base = b;
+        for (std::size_t i = depth; i > split_depth; --i) { base.undoMove(move_stack[i - 1]); }
+        std::pmr::vector<Move> base_path(task.path, &task_memory);
+        for (std::size_t i = 0; i < split_depth; ++i) { base_path.push_back(move_stack[i].move); }
+
+        DepthFirstFrame& frame = frames[split_depth];
+        for (; frame.current_move < frame.valid_moves.size(); ++frame.current_move) {
+            Move const& m = frame.valid_moves[frame.current_move];
+            Task t{ .board = base, .path = std::pmr::vector<Move>(base_path, &task_memory), .last_move = std::nullopt };
+            t.last_move = t.board.applyMove(m);
+            if (!boards.insert(keyFor(t.board), static_cast<std::uint32_t>(base_path.size() + 1))) {
+                ++worker_stats[worker].duplicates;
+                continue;
+            }
+            if (isDeadEndAfter(t.board, m, options)) {
+                ++worker_stats[worker].dead_ends;
+                continue;
+            }
+            t.path.push_back(m);
+            pushTask(worker, std::move(t));
+        }
+    }
+
+    void processTask(std::size_t worker, Task& task, std::vector<DepthFirstFrame>& frames,
+                     std::vector<MoveUndo>& move_stack, MoveHistory& history)
+    {
+        if (task.board.hasWon()) {
+            reportSolution(task.path);
+            return;
+        }
+        if (options.endgame) {
+            if (auto const distance = options.endgame->getDistance(task.board)) {
+                ++worker_stats[worker].endgame_hits;
+                if (auto const moves = options.endgame->getWinningMoves(task.board)) {
+                    std::vector<Move> solution(task.path.begin(), task.path.end());
+                    solution.insert(solution.end(), moves->begin(), moves->end());
+                    reportSolution(solution);
+                }
+                return;
+            }
+        }
+        std::size_t nodes = 0;
+        Board& b = task.board;
+        bool const found = searchDepthFirst(b, task.last_move ? &*task.last_move : nullptr,
+            static_cast<std::uint32_t>(task.path.size()), boards, options, worker_stats[worker], frames, move_stack, history,
+            [&](std::size_t depth) {
+                if (done.load(std::memory_order_relaxed)) { return false; }
+                ++nodes;
+                if (monitor.isActive() && (nodes % SearchMonitor::CheckInterval == 0)) { flushStats(worker); }
+                if ((nodes % SplitCheckInterval == 0) && (idle_workers.load(std::memory_order_relaxed) > 0) &&
+                    !hasQueuedTasks(worker))
+                {
+                    splitWork(worker, task, b, frames, move_stack, depth);
+                }
+                return true;
+            });
+        if (found) {
+            std::vector<Move> moves(task.path.begin(), task.path.end());
+            for (auto const& u : move_stack) { moves.push_back(u.move); }
+            reportSolution(moves);
+        }
+    }
+
+    void runWorker(std::size_t worker)
+    {
+        std::vector<DepthFirstFrame> frames;
+        std::vector<MoveUndo> move_stack;
+        MoveHistory history;
+        while (!done) {
+            std::optional<Task> task = popTask(worker);
+            if (!task) {
+                if (pending_tasks == 0) { break; }
+                ++idle_workers;
+                // a task pushed after the failed pop releases the semaphore, so it can not be missed
+                while (!done && (pending_tasks != 0) && !(task = popTask(worker))) {
+                    work_available.acquire();
+                }
+                --idle_workers;
+                if (!task) { continue; }
+            }
+            processTask(worker, *task, frames, move_stack, history);
+            if (--pending_tasks == 0) { wakeAllWorkers(); }
+        }
+    }
+
+public:
+    /** Constructs the search.
+     * @param[in] memory Upstream for the memory of queued tasks; only released once the search is destroyed.
+     */
+    ParallelDepthFirstSearch(SolverOptions const& opts, std::size_t thread_count, SearchMonitor& search_monitor,
+                             std::pmr::memory_resource* memory)
+        :options(opts), task_memory(memory), boards(thread_count * 4, opts.max_visited_bytes), worker_stats(thread_count),
+         monitor(search_monitor)
+    {
+        for (std::size_t i = 0; i < thread_count; ++i) { queues.push_back(std::make_unique<WorkQueue>()); }
+    }
+
+    std::vector<Move> solve(Board const& b, SearchStats& stats)
+    {
+        std::size_t const thread_count = queues.size();
+        // split the tree breadth-first until there is enough work for all threads
+        std::deque<Task> frontier;
+        frontier.push_back(Task{ .board = b, .path = std::pmr::vector<Move>(&task_memory), .last_move = std::nullopt });
+        boards.insert(keyFor(b), 0);
+        MoveBuffer moves;
+        while (!frontier.empty() && (frontier.size() < thread_count * 8) && (frontier.front().path.size() < 4)) {
+            Task t = std::move(frontier.front());
+            frontier.pop_front();
+            getAllValidMoves(t.board, moves);
+            ++stats.nodes_expanded;
+            stats.moves_generated += moves.size();
+            pruneMoves(t.board, moves, t.last_move ? &*t.last_move : nullptr, options.pruning, stats.pruning);
+            orderMoves(t.board, moves, options.move_ordering);
+            for (auto const& m : moves) {
+                Task child{ .board = t.board, .path = std::pmr::vector<Move>(t.path, &task_memory), .last_move = std::nullopt };
+                child.last_move = child.board.applyMove(m);
+                if (!boards.insert(keyFor(child.board), static_cast<std::uint32_t>(t.path.size() + 1))) {
+                    ++stats.duplicates;
+                    continue;
+                }
+                if (isDeadEndAfter(child.board, m, options)) {
+                    ++stats.dead_ends;
+                    continue;
+                }
+                child.path.push_back(m);
+                stats.peak_depth = std::max<std::uint64_t>(stats.peak_depth, child.path.size());
+                if (child.board.hasWon()) {
+                    updateVisitedStats(stats, boards);
+                    return std::vector<Move>(child.path.begin(), child.path.end());
+                }
+                frontier.push_back(std::move(child));
+            }
+        }
+        for (std::size_t i = 0; !frontier.empty(); ++i) {
+            pushTask(i % thread_count, std::move(frontier.front()));
+            frontier.pop_front();
+        }
+
+        {
+            std::vector<std::jthread> workers;
+            for (std::size_t i = 0; i < thread_count; ++i) {
+                workers.emplace_back([this, i]() { runWorker(i); });
+            }
+        }
+
+        for (auto const& ws : worker_stats) { total_stats.merge(ws); }
+        stats.merge(total_stats);
+        updateVisitedStats(stats, boards);
+        return result.value_or(std::vector<Move>{});
+    }
+};
+
+/** Node of the A* search tree.
+ * Nodes only store the packed board; the board itself is reconstructed from the key when expanding the node.
+ */
+struct AStarNode {
+    BoardKey key;
+    std::uint32_t parent;
+    std::uint16_t g;
+    std::int8_t from;
+    std::int8_t to;
+    std::int8_t size;
+    bool collapsed;
+    /// The board is covered by the endgame table, which provides the remaining moves.
+    bool endgame;
+};
+/** Entry of the A* open list, ordered by priority.
+ */
+struct AStarOpenEntry {
+    double f;
+    int h;
+    int free_swaps;
+    std::uint32_t node;
+
+    bool operator<(AStarOpenEntry const& rhs) const noexcept {
+        // the open list is a max-heap, so lower priorities compare greater
+        if (f != rhs.f) { return f > rhs.f; }
+        if (h != rhs.h) { return h > rhs.h; }
+        return free_swaps < rhs.free_swaps;
+    }
+};
+
+/** Memory limit for the visited table used with the given options.
+ */
+std::size_t visitedTableBytes(SolverOptions const& options)
+{
+    if ((options.strategy == SearchStrategy::IterativeDeepening) && (options.max_visited_bytes == 0)) {
+        return DefaultTranspositionCacheBytes;
+    }
+    return options.max_visited_bytes;
+}
+}
+
+/** Storage shared by all searches of a Solver.
+ *
+ * The visited table keeps the capacity it grew to and is only cleared between searches.
+ * The parallel depth-first search starts its own threads for each search and does not reuse storage.
+ */
+struct Solver::Impl {
+    SolverOptions options;
+    VisitedTable boards;
+    std::vector<DepthFirstFrame> frames;
+    std::vector<MoveUndo> move_stack;
+    MoveHistory history;
+    std::vector<AStarNode> nodes;
+    std::vector<AStarOpenEntry> open;
+    /// Scratch memory for a single solve() call, released as a whole afterwards.
+    std::pmr::monotonic_buffer_resource arena;
+
+    explicit Impl(SolverOptions const& opts)
+        :options(opts), boards(visitedTableBytes(opts))
+    {}
+
+    BoardKey keyFor(Board const& board) const {
+        return options.canonicalize ? board.getCanonicalKey() : board.getKey();
+    }
+
+    std::vector<Move> pathFromMoveStack() const
+    {
+        std::vector<Move> ret;
+        ret.reserve(move_stack.size());
+        for (auto const& u : move_stack) { ret.push_back(u.move); }
+        return ret;
+    }
+
+    std::size_t getStorageBytes() const {
+        return frames.size() * sizeof(DepthFirstFrame) + move_stack.capacity() * sizeof(MoveUndo) +
+               nodes.capacity() * sizeof(AStarNode) + open.capacity() * sizeof(AStarOpenEntry);
+    }
+
+    std::vector<Move> solveDepthFirst(Board b, SearchStats& stats, SearchMonitor& monitor);
+    std::vector<Move> solveParallel(Board const& b, SearchStats& stats, SearchMonitor& monitor);
+    std::vector<Move> solveAStar(Board const& b, SearchStats& stats, SearchMonitor& monitor);
+    std::vector<Move> solveIterativeDeepening(Board b, SearchStats& stats, SearchMonitor& monitor);
+    std::vector<Move> solveAnytime(Board b, SearchStats& stats, SearchMonitor& monitor);
+};
+
+std::vector<Move> Solver::Impl::solveDepthFirst(Board b, SearchStats& stats, SearchMonitor& monitor)
+{
+    std::uint64_t moves_tried = 0;
+    bool const found = searchDepthFirst(b, nullptr, 0, boards, options, stats, frames, move_stack, history, [&](std::size_t) {
+            if (++moves_tried % SearchMonitor::CheckInterval != 0) { return true; }
+            return monitor.check(stats, boards, getStorageBytes());
+        });
+    return found ? pathFromMoveStack() : std::vector<Move>{};
+}
+
+std::vector<Move> Solver::Impl::solveParallel(Board const& b, SearchStats& stats, SearchMonitor& monitor)
+{
+    std::vector<Move> ret;
+    {
+        ParallelDepthFirstSearch search(options, options.threads, monitor, &arena);
+        ret = search.solve(b, stats);
+    }
+    arena.release();
+    return ret;
+}
+
+std::vector<Move> Solver::Impl::solveAStar(Board const& b, SearchStats& stats, SearchMonitor& monitor)
+{
+    MoveBuffer moves;
+    nodes.clear();
+    open.clear();
+    std::size_t const storage_limit = (options.max_visited_bytes != 0) ? options.max_visited_bytes : DefaultAStarStorageBytes;
+
+    nodes.push_back(AStarNode{ .key = b.getKey(), .parent = 0, .g = 0, .from = 0, .to = 0, .size = 0, .collapsed = false,
+                               .endgame = false });
+    boards.insertOrImprove(keyFor(b), 0);
+    open.push_back(AStarOpenEntry{ .f = 0.0, .h = 0, .free_swaps = 0, .node = 0 });
+    while (!open.empty()) {
+        std::pop_heap(open.begin(), open.end());
+        std::uint32_t const node_index = open.back().node;
+        open.pop_back();
+        AStarNode const node = nodes[node_index];
+        Board board = Board::fromKey(node.key);
+        if (auto const best_g = boards.find(keyFor(board)); best_g && (*best_g < node.g)) {
+            // a shorter path to this board was found after this node was queued
+            continue;
+        }
+        std::optional<std::vector<Move>> endgame_moves;
+        if (node.endgame) { endgame_moves = options.endgame->getWinningMoves(board); }
+        if (board.hasWon() || endgame_moves) {
+            std::vector<Move> ret;
+            for (std::uint32_t i = node_index; i != 0; i = nodes[i].parent) {
+                ret.push_back(Move{ .from = nodes[i].from, .to = nodes[i].to, .size = nodes[i].size });
+            }
+            std::ranges::reverse(ret);
+            if (endgame_moves) { ret.insert(ret.end(), endgame_moves->begin(), endgame_moves->end()); }
+            return ret;
+        }
+        getAllValidMoves(board, moves);
+        ++stats.nodes_expanded;
+        stats.moves_generated += moves.size();
+        if (stats.nodes_expanded % SearchMonitor::CheckInterval == 0) {
+            if (!monitor.check(stats, boards, getStorageBytes())) { return {}; }
+            // nodes are never released during the search, so their storage has to be bounded separately
+            if (boards.memoryUsage() + getStorageBytes() > storage_limit) {
+                monitor.giveUp(SearchLimit::Memory);
+                return {};
+            }
+        }
+        if (node_index != 0) {
+            MoveUndo const last_move{ .move = Move{ .from = node.from, .to = node.to, .size = node.size },
+                                      .collapsed = node.collapsed, .unlocked_swap = false };
+            pruneMoves(board, moves, &last_move, options.pruning, stats.pruning);
+        } else {
+            pruneMoves(board, moves, nullptr, options.pruning, stats.pruning);
+        }
+        std::uint16_t const g = node.g + 1;
+        stats.peak_depth = std::max<std::uint64_t>(stats.peak_depth, g);
+        for (auto const& m : moves) {
+            MoveUndo const undo = board.applyMove(m);
+            if (!boards.insertOrImprove(keyFor(board), g)) {
+                ++stats.duplicates;
+            } else if (isDeadEndAfter(board, m, options)) {
+                ++stats.dead_ends;
+            } else if (std::optional<int> const distance = probeEndgameAfter(board, m, options);
+                       distance == EndgameTable::Lost)
+            {
+                ++stats.endgame_hits;
+            } else {
+                if (distance) { ++stats.endgame_hits; }
+                int const h = distance.value_or(estimateRemainingMoves(board));
+                auto const child_index = static_cast<std::uint32_t>(nodes.size());
+                nodes.push_back(AStarNode{ .key = board.getKey(), .parent = node_index, .g = g,
+                                      .from = static_cast<std::int8_t>(m.from), .to = static_cast<std::int8_t>(m.to),
+                                      .size = static_cast<std::int8_t>(m.size), .collapsed = undo.collapsed,
+                                      .endgame = distance.has_value() });
+                open.push_back(AStarOpenEntry{ .f = g + options.heuristic_weight * h, .h = h,
+                                               .free_swaps = countFreeSwaps(board), .node = child_index });
+                std::push_heap(open.begin(), open.end());
+            }
+            board.undoMove(undo);
+        }
+    }
+    return {};
+}
+
+std::vector<Move> Solver::Impl::solveIterativeDeepening(Board b, SearchStats& stats, SearchMonitor& monitor)
+{
+    // remembers the shallowest depth at which a board was seen during the current iteration
+    VisitedTable& cache = boards;
+    if (frames.empty()) { frames.emplace_back(); }
+    move_stack.clear();
+    double const w = options.heuristic_weight;
+
+    // repeat a depth-first search, each time allowing slightly more expensive paths than before
+    double bound = w * estimateRemainingMoves(b);
+    for (;;) {
+        double next_bound = std::numeric_limits<double>::infinity();
+        updateVisitedStats(stats, cache);
+        cache.clear();
+        cache.insertOrImprove(keyFor(b), 0);
+        std::size_t depth = 0;
+        frames[0].current_move = 0;
+        getAllValidMoves(b, frames[0].valid_moves);
+        ++stats.nodes_expanded;
+        stats.moves_generated += frames[0].valid_moves.size();
+        pruneMoves(b, frames[0].valid_moves, nullptr, options.pruning, stats.pruning);
+        history.orderMoves(b, frames[0].valid_moves, options.move_ordering);
+        for (;;) {
+            DepthFirstFrame& frame = frames[depth];
+            if (frame.current_move == frame.valid_moves.size()) {
+                // no more moves at this level; backtrack
+                if (depth == 0) { break; }
+                --depth;
+                b.undoMove(move_stack.back());
+                move_stack.pop_back();
+                continue;
+            }
+            Move const m = frame.valid_moves[frame.current_move];
+            ++frame.current_move;
+            MoveUndo const undo = b.applyMove(m);
+            auto const g = static_cast<std::uint32_t>(depth + 1);
+            double const f = g + w * estimateRemainingMoves(b);
+            if (f > bound) {
+                next_bound = std::min(next_bound, f);
+                b.undoMove(undo);
+                continue;
+            }
+            if (!cache.insertOrImprove(keyFor(b), g)) {
+                // already explored from the same or a shallower depth in this iteration
+                ++stats.duplicates;
+                b.undoMove(undo);
+                continue;
+            }
+            if (isDeadEndAfter(b, m, options)) {
+                ++stats.dead_ends;
+                b.undoMove(undo);
+                continue;
+            }
+            std::optional<int> const distance = probeEndgameAfter(b, m, options);
+            if (distance) {
+                ++stats.endgame_hits;
+                if (distance == EndgameTable::Lost) {
+                    b.undoMove(undo);
+                    continue;
+                }
+                // the distance is exact, so the board is either won within the bound or not in this iteration
+                double const exact_f = g + w * *distance;
+                if (exact_f > bound) {
+                    next_bound = std::min(next_bound, exact_f);
+                    b.undoMove(undo);
+                    continue;
+                }
+            }
+            move_stack.push_back(undo);
+            if (undo.collapsed) { history.recordCollapse(move_stack); }
+            stats.peak_depth = std::max<std::uint64_t>(stats.peak_depth, g);
+            if (b.hasWon() || (distance && playEndgame(b, *options.endgame, move_stack))) { return pathFromMoveStack(); }
+            ++depth;
+            if (depth == frames.size()) { frames.emplace_back(); }
+            frames[depth].current_move = 0;
+            getAllValidMoves(b, frames[depth].valid_moves);
+            ++stats.nodes_expanded;
+            stats.moves_generated += frames[depth].valid_moves.size();
+            if ((stats.nodes_expanded % SearchMonitor::CheckInterval == 0) && !monitor.check(stats, cache, getStorageBytes())) {
+                return {};
+            }
+            pruneMoves(b, frames[depth].valid_moves, &move_stack.back(), options.pruning, stats.pruning);
+            history.orderMoves(b, frames[depth].valid_moves, options.move_ordering);
+        }
+        // every path has been explored without hitting the bound
+        if (next_bound == std::numeric_limits<double>::infinity()) { return {}; }
+        bound = next_bound;
+    }
+}
+
+std::vector<Move> Solver::Impl::solveAnytime(Board b, SearchStats& stats, SearchMonitor& monitor)
+{
+    Board const initial = b;
+    std::vector<Move> best;
+    auto const improve = [this, &initial, &best, &stats](std::vector<Move> moves) {
+        std::size_t const length = moves.size();
+        if (options.shorten_solutions) { moves = shortenSolution(initial, std::move(moves), options.shorten_depth); }
+        if (!best.empty() && (moves.size() >= best.size())) { return; }
+        // reported for the solution that ends up being returned
+        stats.moves_shortened = length - moves.size();
+        best = std::move(moves);
+        if (options.on_solution) { options.on_solution(best); }
+    };
+    // the first solution comes from a plain depth-first search
+    std::vector<Move> first = solveDepthFirst(b, stats, monitor);
+    if (first.empty()) { return first; }
+    improve(std::move(first));
+
+    // branch and bound: only search boards from which a solution shorter than the best one is still possible
+    updateVisitedStats(stats, boards);
+    boards.clear();
+    boards.insertOrImprove(keyFor(b), 0);
+    move_stack.clear();
+    std::size_t depth = 0;
+    frames[0].current_move = 0;
+    getAllValidMoves(b, frames[0].valid_moves);
+    ++stats.nodes_expanded;
+    stats.moves_generated += frames[0].valid_moves.size();
+    pruneMoves(b, frames[0].valid_moves, nullptr, options.pruning, stats.pruning);
+    history.orderMoves(b, frames[0].valid_moves, options.move_ordering);
+    for (;;) {
+        DepthFirstFrame& frame = frames[depth];
+        if (frame.current_move == frame.valid_moves.size()) {
+            // no more moves at this level; backtrack
+            if (depth == 0) { break; }
+            --depth;
+            b.undoMove(move_stack.back());
+            move_stack.pop_back();
+            continue;
+        }
+        Move const m = frame.valid_moves[frame.current_move];
+        ++frame.current_move;
+        MoveUndo const undo = b.applyMove(m);
+        auto const g = static_cast<std::uint32_t>(depth + 1);
+        // the estimate never exceeds the moves actually required
+        if (g + estimateRemainingMoves(b) >= best.size()) {
+            b.undoMove(undo);
+            continue;
+        }
+        if (!boards.insertOrImprove(keyFor(b), g)) {
+            // searched before from the same or a shallower depth, and against a bound at least as large
+            ++stats.duplicates;
+            b.undoMove(undo);
+            continue;
+        }
+        if (isDeadEndAfter(b, m, options)) {
+            ++stats.dead_ends;
+            b.undoMove(undo);
+            continue;
+        }
+        move_stack.push_back(undo);
+        if (undo.collapsed) { history.recordCollapse(move_stack); }
+        stats.peak_depth = std::max<std::uint64_t>(stats.peak_depth, g);
+        std::optional<int> const distance = probeEndgameAfter(b, m, options);
+        if (distance) {
+            // the table settles the board either way, so it is not searched further
+            ++stats.endgame_hits;
+            std::size_t const path_length = move_stack.size();
+            if ((distance != EndgameTable::Lost) && (g + *distance < best.size()) &&
+                playEndgame(b, *options.endgame, move_stack))
+            {
+                history.recordSolution(move_stack);
+                improve(pathFromMoveStack());
+            }
+            while (move_stack.size() >= path_length) {
+                b.undoMove(move_stack.back());
+                move_stack.pop_back();
+            }
+            continue;
+        }
+        if (b.hasWon()) {
+            history.recordSolution(move_stack);
+            improve(pathFromMoveStack());
+            b.undoMove(move_stack.back());
+            move_stack.pop_back();
+            continue;
+        }
+        ++depth;
+        if (depth == frames.size()) { frames.emplace_back(); }
+        frames[depth].current_move = 0;
+        getAllValidMoves(b, frames[depth].valid_moves);
+        ++stats.nodes_expanded;
+        stats.moves_generated += frames[depth].valid_moves.size();
+        if ((stats.nodes_expanded % SearchMonitor::CheckInterval == 0) && !monitor.check(stats, boards, getStorageBytes())) {
+            break;
+        }
+        pruneMoves(b, frames[depth].valid_moves, &move_stack.back(), options.pruning, stats.pruning);
+        history.orderMoves(b, frames[depth].valid_moves, options.move_ordering);
+    }
+    return best;
+}
+
+Solver::Solver(SolverOptions const& options)
+    :impl(std::make_unique<Impl>(options))
+{}
+
+Solver::~Solver() = default;
+Solver::Solver(Solver&&) noexcept = default;
+Solver& Solver::operator=(Solver&&) noexcept = default;
+
+SolverOptions const& Solver::getOptions() const
+{
+    return impl->options;
+}
+
+void Solver::setOptions(SolverOptions const& options)
+{
+    bool const resize_table = (visitedTableBytes(options) != visitedTableBytes(impl->options));
+    impl->options = options;
+    if (resize_table) { impl->boards = VisitedTable(visitedTableBytes(options)); }
+}
+
+namespace {
+/** Tests whether a search with the given options only reports solutions that are proven to be shortest,
+ * unless it gives up.
+ */
+bool findsShortestSolutions(SolverOptions const& options)
+{
+    switch (options.strategy) {
+    case SearchStrategy::AStar:
+    case SearchStrategy::IterativeDeepening:
+        return options.heuristic_weight <= 1.0;
+    case SearchStrategy::Anytime:
+        return true;
+    default:
+        return false;
+    }
+}
+}
+
+SolveResult Solver::solve(Board const& b)
+{
+    SolveResult ret;
+    if (b.hasWon()) {
+        ret.status = SolveStatus::Solved;
+        ret.is_shortest = true;
+        return ret;
+    }
+    bool const wants_shortest = findsShortestSolutions(impl->options);
+    SolutionCache* const cache = impl->options.cache;
+    if (cache) {
+        // a cached solution that may be longer than necessary does not answer a search for a shortest one
+        auto cached = cache->lookup(b);
+        if (cached && (cached->is_shortest || !wants_shortest || (cached->status == SolveStatus::Unsolvable))) {
+            return std::move(*cached);
+        }
+    }
+    if (impl->options.detect_dead_ends && isDeadEnd(b)) {
+        ret.stats.dead_ends = 1;
+        if (cache) { cache->store(b, ret); }
+        return ret;
+    }
+    if (impl->options.endgame && impl->options.endgame->getDistance(b)) {
+        ret.stats.endgame_hits = 1;
+        if (auto moves = impl->options.endgame->getWinningMoves(b)) {
+            ret.status = SolveStatus::Solved;
+            ret.moves = std::move(*moves);
+            // the table holds exact distances
+            ret.is_shortest = true;
+        }
+        return ret;
+    }
+    impl->boards.clear();
+    impl->history.clear();
+    auto const t0 = std::chrono::steady_clock::now();
+    SearchMonitor monitor(impl->options);
+    switch (impl->options.strategy) {
+    case SearchStrategy::AStar:         ret.moves = impl->solveAStar(b, ret.stats, monitor); break;
+    case SearchStrategy::IterativeDeepening: ret.moves = impl->solveIterativeDeepening(b, ret.stats, monitor); break;
+    case SearchStrategy::Anytime:       ret.moves = impl->solveAnytime(b, ret.stats, monitor); break;
+    default:                            ret.moves = (impl->options.threads > 1) ? impl->solveParallel(b, ret.stats, monitor) :
+                                                                                  impl->solveDepthFirst(b, ret.stats, monitor);
+    }
+    // the anytime search shortens every solution it finds itself
+    if (!ret.moves.empty() && impl->options.shorten_solutions && (impl->options.strategy != SearchStrategy::Anytime)) {
+        std::size_t const length = ret.moves.size();
+        ret.moves = shortenSolution(b, std::move(ret.moves), impl->options.shorten_depth);
+        ret.stats.moves_shortened = length - ret.moves.size();
+    }
+    ret.stats.elapsed = std::chrono::steady_clock::now() - t0;
+    updateVisitedStats(ret.stats, impl->boards);
+    if (!ret.moves.empty()) {
+        ret.status = SolveStatus::Solved;
+        // the anytime search only proves its best solution to be shortest if it ran to completion
+        ret.is_shortest = wants_shortest && (monitor.getExceededLimit() == SearchLimit::None);
+    } else if (monitor.getExceededLimit() != SearchLimit::None) {
+        ret.status = SolveStatus::GaveUp;
+        ret.exceeded_limit = monitor.getExceededLimit();
+    }
+    if (cache) { cache->store(b, ret); }
+    return ret;
+}
+
+namespace {
+/** Removes the moves between two visits of the same board.
+ * @return true if any moves were removed.
+ */
+bool removeCycles(Board b, std::vector<Move>& moves)
+{
+    // the boards of the shortened solution, and for each the number of moves leading to it
+    std::unordered_map<BoardKey, std::size_t> seen{ { b.getKey(), 0 } };
+    std::vector<BoardKey> keys{ b.getKey() };
+    std::vector<Move> ret;
+    for (auto const& m : moves) {
+        b.applyMove(m);
+        BoardKey const key = b.getKey();
+        if (auto const it = seen.find(key); it != seen.end()) {
+            std::size_t const length = it->second;
+            while (ret.size() > length) {
+                seen.erase(keys.back());
+                keys.pop_back();
+                ret.pop_back();
+            }
+        } else {
+            ret.push_back(m);
+            keys.push_back(key);
+            seen.emplace(key, ret.size());
+        }
+    }
+    bool const changed = (ret.size() != moves.size());
+    moves = std::move(ret);
+    return changed;
+}
+
+/** Merges consecutive moves between the same two places into a single move.
+ * @return true if any moves were merged.
+ */
+bool mergeMoves(Board b, std::vector<Move>& moves)
+{
+    bool changed = false;
+    for (std::size_t i = 0; i < moves.size(); ) {
+        if ((i + 1 < moves.size()) && (moves[i].from == moves[i + 1].from) && (moves[i].to == moves[i + 1].to)) {
+            Move const merged{ .from = moves[i].from, .to = moves[i].to, .size = moves[i].size + moves[i + 1].size };
+            if (moveIsValid(merged) && moveIsValidForBoard(b, merged) &&
+                (executeMove(b, merged) == executeMove(executeMove(b, moves[i]), moves[i + 1])))
+            {
+                moves[i] = merged;
+                moves.erase(moves.begin() + static_cast<std::ptrdiff_t>(i) + 1);
+                changed = true;
+                continue;
+            }
+        }
+        b.applyMove(moves[i]);
+        ++i;
+    }
+    return changed;
+}
+
+/** Replaces parts of the solution by shorter sequences of at most search_depth moves.
+ * From each board of the solution, all sequences of up to search_depth moves are tried. If one of them
+ * reaches a later board of the solution, or wins, in fewer moves than the solution, it takes their place.
+ * @return true if the solution was shortened.
+ */
+bool spliceShortcuts(Board const& b, std::vector<Move>& moves, int search_depth)
+{
+    if (search_depth <= 0) { return false; }
+    bool changed = false;
+    std::vector<MoveBuffer> buffers(static_cast<std::size_t>(search_depth));
+    std::vector<Move> path;
+    std::vector<Move> best_path;
+    std::unordered_map<BoardKey, std::size_t> index;
+    Board current = b;
+    for (std::size_t i = 0; i + 1 < moves.size(); ++i) {
+        // the number of moves leading to each of the remaining boards
+        index.clear();
+        Board later = current;
+        for (std::size_t j = i; j < moves.size(); ++j) {
+            later.applyMove(moves[j]);
+            index.emplace(later.getKey(), j + 1);
+        }
+        std::size_t best_target = 0;
+        std::size_t best_saving = 0;
+        auto const search = [&](auto const& self, Board& board) -> void {
+            MoveBuffer& candidates = buffers[path.size()];
+            getAllValidMoves(board, candidates);
+            for (auto const& m : candidates) {
+                MoveUndo const undo = board.applyMove(m);
+                path.push_back(m);
+                std::size_t target = 0;
+                if (board.hasWon()) {
+                    target = moves.size();
+                } else if (auto const it = index.find(board.getKey()); it != index.end()) {
+                    target = it->second;
+                }
+                if ((target > i + path.size()) && (target - i - path.size() > best_saving)) {
+                    best_saving = target - i - path.size();
+                    best_target = target;
+                    best_path = path;
+                }
+                if (path.size() < buffers.size()) { self(self, board); }
+                path.pop_back();
+                board.undoMove(undo);
+            }
+        };
+        search(search, current);
+        if (best_saving > 0) {
+            moves.erase(moves.begin() + static_cast<std::ptrdiff_t>(i), moves.begin() + static_cast<std::ptrdiff_t>(best_target));
+            moves.insert(moves.begin() + static_cast<std::ptrdiff_t>(i), best_path.begin(), best_path.end());
+            changed = true;
+        }
+        if (i < moves.size()) { current.applyMove(moves[i]); }
+    }
+    return changed;
+}
+}
+
+std::vector<Move> shortenSolution(Board const& b, std::vector<Move> moves, int search_depth)
+{
+    std::vector<Move> const original = moves;
+    for (;;) {
+        bool changed = removeCycles(b, moves);
+        changed = mergeMoves(b, moves) || changed;
+        changed = spliceShortcuts(b, moves, search_depth) || changed;
+        if (!changed) { break; }
+    }
+    // only ever return a solution that has been checked to win
+    Board replay = b;
+    for (auto const& m : moves) {
+        if (!moveIsValid(m) || !moveIsValidForBoard(replay, m)) { return original; }
+        replay.applyMove(m);
+    }
+    return replay.hasWon() ? moves : original;
+}
+
+namespace {
+/// Size of a canonical board key in a cache record.
+constexpr std::size_t CacheKeySize = 32;
+/// Size of the part of a cache record that precedes the solution record: the key and the flags byte.
+constexpr std::size_t CacheRecordPrefixSize = CacheKeySize + 1;
+constexpr std::uint8_t CacheFlagShortest = 0x01;
+
+/** Positions of the stacks and swaps of an initial board in its canonical order.
+ * Element i is the index into Board::field or Board::swaps of the slot that comes i-th in the canonical key.
+ */
+struct CanonicalOrder {
+    std::array<int, 4> swaps;
+    std::array<int, 8> field;
+};
+
+/** Only initial boards are cached; their canonical order is simple to reconstruct.
+ */
+bool isCacheable(Board const& b)
+{
+    return std::ranges::all_of(b.swaps, [](SwapField const& s) { return s.isLocked() || s.isFree(); }) &&
+           std::ranges::none_of(b.field, [](CardStack const& s) { return s.isCollapsed(); });
+}
+
+CanonicalOrder getCanonicalOrder(Board const& b)
+{
+    CanonicalOrder ret{ .swaps = { 0, 1, 2, 3 }, .field = { 0, 1, 2, 3, 4, 5, 6, 7 } };
+    // Locked swaps come first in the canonical key. They are unlocked from left to right,
+    // so keep their relative order to unlock the same swaps in both orders.
+    std::ranges::stable_partition(ret.swaps, [&b](int i) { return b.swaps[i].isLocked(); });
+    std::ranges::stable_sort(ret.field, [&b](int lhs, int rhs) {
+        return std::lexicographical_compare(b.field[lhs].begin(), b.field[lhs].end(), b.field[rhs].begin(), b.field[rhs].end());
+    });
+    return ret;
+}
+
+/** Maps a slot index of the canonically ordered board to the corresponding slot of the original board.
+ */
+int fromCanonicalSlot(CanonicalOrder const& order, int i)
+{
+    return isSwapIndex(i) ? -(order.swaps[(-i) - 1] + 1) : order.field[i];
+}
+
+int toCanonicalSlot(CanonicalOrder const& order, int i)
+{
+    if (isSwapIndex(i)) {
+        return -(static_cast<int>(std::ranges::find(order.swaps, (-i) - 1) - order.swaps.begin()) + 1);
+    }
+    return static_cast<int>(std::ranges::find(order.field, i) - order.field.begin());
+}
+
+void encodeCacheKey(BoardKey const& key, std::string& out)
+{
+    for (std::uint64_t const w : key.words) {
+        for (int i = 0; i < 8; ++i) { out.push_back(static_cast<char>((w >> (8 * i)) & 0xff)); }
+    }
+}
+
+BoardKey decodeCacheKey(std::string_view data)
+{
+    BoardKey ret;
+    for (std::size_t i = 0; i < CacheKeySize; ++i) {
+        ret.words[i / 8] |= static_cast<std::uint64_t>(static_cast<std::uint8_t>(data[i])) << (8 * (i % 8));
+    }
+    return ret;
+}
+}
+
+struct SolutionCache::Impl {
+    std::optional<MappedFile> contents;
+    /// File receiving new records; null if the file can not be appended to safely.
+    std::FILE* out = nullptr;
+    mutable std::mutex mutex;
+    struct Record {
+        /// Solution record within contents or added_records.
+        std::string_view solution;
+        bool is_shortest;
+    };
+    std::unordered_map<BoardKey, Record> records;
+    /// Records stored since the file was opened.
+    std::deque<std::string> added_records;
+
+    ~Impl()
+    {
+        if (out) { std::fclose(out); }
+    }
+};
+
+SolutionCache::SolutionCache()
+    :impl(std::make_unique<Impl>())
+{}
+
+SolutionCache::~SolutionCache() = default;
+SolutionCache::SolutionCache(SolutionCache&&) noexcept = default;
+SolutionCache& SolutionCache::operator=(SolutionCache&&) noexcept = default;
+
+std::optional<SolutionCache> SolutionCache::open(char const* filename)
+{
+    SolutionCache ret;
+    std::error_code ec;
+    bool const exists = std::filesystem::exists(filename, ec) && (std::filesystem::file_size(filename, ec) > 0);
+    bool complete = true;
+    if (exists) {
+        ret.impl->contents = MappedFile::open(filename);
+        if (!ret.impl->contents) { return std::nullopt; }
+        auto records = getBinaryContents(ret.impl->contents->getContents(), BinaryCacheMagic, BinaryCacheVersion);
+        if (!records) {
+            fmt::print(stderr, "File '{}' is not a solution cache of version {}.\n", filename, BinaryCacheVersion);
+            return std::nullopt;
+        }
+        BinarySolutionStatus status = BinarySolutionStatus::Invalid;
+        std::vector<Move> moves;
+        while (!records->empty()) {
+            std::size_t const size = (records->size() > CacheRecordPrefixSize) ?
+                decodeBinarySolution(records->substr(CacheRecordPrefixSize), status, moves) : 0;
+            if (size == 0) {
+                fmt::print(stderr, "Solution cache '{}' ends in an incomplete record; new results will not be stored.\n", filename);
+                complete = false;
+                break;
+            }
+            bool const is_shortest = (static_cast<std::uint8_t>((*records)[CacheKeySize]) & CacheFlagShortest) != 0;
+            Impl::Record const record{ .solution = records->substr(CacheRecordPrefixSize, size), .is_shortest = is_shortest };
+            // later records only replace earlier ones if they are better, see store()
+            auto const [it, inserted] = ret.impl->records.emplace(decodeCacheKey(*records), record);
+            if (!inserted && is_shortest && !it->second.is_shortest) { it->second = record; }
+            records->remove_prefix(CacheRecordPrefixSize + size);
+        }
+    }
+    if (complete) {
+        ret.impl->out = std::fopen(filename, "ab");
+        if (!ret.impl->out) {
+            fmt::print(stderr, "Unable to open solution cache '{}' for writing.\n", filename);
+            return std::nullopt;
+        }
+        if (!exists) {
+            std::string header;
+            writeBinaryHeader(BinaryCacheMagic, header, BinaryCacheVersion);
+            std::fwrite(header.data(), 1, header.size(), ret.impl->out);
+            std::fflush(ret.impl->out);
+        }
+    }
+    return ret;
+}
+
+std::optional<SolveResult> SolutionCache::lookup(Board const& b) const
+{
+    if (!isCacheable(b)) { return std::nullopt; }
+    Impl::Record record;
+    {
+        std::scoped_lock lk(impl->mutex);
+        auto const it = impl->records.find(b.getCanonicalKey());
+        if (it == impl->records.end()) { return std::nullopt; }
+        record = it->second;
+    }
+    SolveResult ret;
+    ret.is_shortest = record.is_shortest;
+    BinarySolutionStatus status = BinarySolutionStatus::Invalid;
+    if (decodeBinarySolution(record.solution, status, ret.moves) == 0) { return std::nullopt; }
+    if (status == BinarySolutionStatus::Unsolvable) {
+        ret.status = SolveStatus::Unsolvable;
+        ret.moves.clear();
+    } else if (status == BinarySolutionStatus::Solved) {
+        ret.status = SolveStatus::Solved;
+        CanonicalOrder const order = getCanonicalOrder(b);
+        Board replay = b;
+        for (auto& m : ret.moves) {
+            if (!moveIsValid(m)) { return std::nullopt; }
+            m = Move{ .from = fromCanonicalSlot(order, m.from), .to = fromCanonicalSlot(order, m.to), .size = m.size };
+            if (!moveIsValidForBoard(replay, m)) { return std::nullopt; }
+            replay.applyMove(m);
+        }
+        if (!replay.hasWon()) { return std::nullopt; }
+    } else {
+        return std::nullopt;
+    }
+    ret.from_cache = true;
+    return ret;
+}
+
+void SolutionCache::store(Board const& b, SolveResult const& result)
+{
+    if ((result.status == SolveStatus::GaveUp) || !isCacheable(b)) { return; }
+    BoardKey const key = b.getCanonicalKey();
+    CanonicalOrder const order = getCanonicalOrder(b);
+    std::vector<Move> moves;
+    for (auto const& m : result.moves) {
+        moves.push_back(Move{ .from = toCanonicalSlot(order, m.from), .to = toCanonicalSlot(order, m.to), .size = m.size });
+    }
+    std::string record;
+    encodeCacheKey(key, record);
+    record.push_back(static_cast<char>(result.is_shortest ? CacheFlagShortest : 0));
+    encodeBinarySolution((result.status == SolveStatus::Solved) ? BinarySolutionStatus::Solved : BinarySolutionStatus::Unsolvable,
+                         moves, record);
+
+    std::scoped_lock lk(impl->mutex);
+    auto const it = impl->records.find(key);
+    if ((it != impl->records.end()) && (it->second.is_shortest || !result.is_shortest)) { return; }
+    if (impl->out) {
+        std::fwrite(record.data(), 1, record.size(), impl->out);
+        std::fflush(impl->out);
+    }
+    std::string const& added = impl->added_records.emplace_back(std::move(record));
+    impl->records.insert_or_assign(key, Impl::Record{ .solution = std::string_view(added).substr(CacheRecordPrefixSize),
+                                                      .is_shortest = result.is_shortest });
+}
+
+std::size_t SolutionCache::size() const
+{
+    std::scoped_lock lk(impl->mutex);
+    return impl->records.size();
+}
+
+namespace {
+/** Key of a board in the endgame table.
+ *
+ * The key is a sequence of 4 bit codes: first those of the swaps, then those of the stacks, each sorted.
+ * A swap is 0xB if free, 0xC if collapsed, or the card it holds. A stack is 0xC if collapsed,
+ * or its cards followed by 0xF. The suits that are still in play are numbered from 0,
+ * in the way that gives the smallest key, so the key does not depend on the suits either.
+ */
+struct EndgameKey {
+    std::uint64_t low = 0;
+    std::uint64_t high = 0;
+
+    friend auto operator<=>(EndgameKey const&, EndgameKey const&) = default;
+};
+
+struct EndgameKeyHash {
+    std::size_t operator()(EndgameKey const& k) const noexcept
+    {
+        std::size_t h = 0;
+        detail::hash_combine(h, k.low);
+        detail::hash_combine(h, k.high);
+        return h;
+    }
+};
+
+constexpr std::size_t EndgameKeySize = 16;
+constexpr std::size_t EndgameRecordSize = EndgameKeySize + 1;
+/// Distance stored for boards that can not be won.
+constexpr std::uint8_t EndgameLostDistance = 0xff;
+
+/** Number of suits that have not been collapsed; std::nullopt if a swap is still locked.
+ */
+std::optional<int> countLooseSuits(Board const& b)
+{
+    int collapsed = 0;
+    for (auto const& s : b.swaps) {
+        if (s.isLocked()) { return std::nullopt; }
+        if (s.isCollapsed()) { ++collapsed; }
+    }
+    for (auto const& s : b.field) {
+        if (s.isCollapsed()) { ++collapsed; }
+    }
+    return 10 - collapsed;
+}
+
+/** Computes the EndgameKey of a board without locked swaps.
+ */
+EndgameKey getEndgameKey(Board const& b)
+{
+    // the suits in play, each with the number it gets in the key
+    std::array<bool, 10> is_collapsed{};
+    for (auto const& s : b.swaps) {
+        if (s.isCollapsed()) { is_collapsed[s.getCard()] = true; }
+    }
+    for (auto const& s : b.field) {
+        if (s.isCollapsed()) { is_collapsed[s.getTop()] = true; }
+    }
+    std::array<int, 10> suits;
+    int loose_suits = 0;
+    for (int i = 0; i < 10; ++i) {
+        if (!is_collapsed[i]) { suits[loose_suits++] = i; }
+    }
+    std::array<std::uint8_t, 10> labels{};
+
+    using StackCode = std::array<std::uint8_t, CardStack::MaxCards + 1>;
+    std::array<StackCode, 8> stacks;
+    std::array<std::uint8_t, 4> swaps;
+    std::optional<EndgameKey> best;
+    do {
+        for (int i = 0; i < loose_suits; ++i) { labels[suits[i]] = static_cast<std::uint8_t>(i); }
+        for (std::size_t i = 0; i < 4; ++i) {
+            SwapField const& s = b.swaps[i];
+            swaps[i] = s.isFree() ? 0xB : (s.isCollapsed() ? 0xC : labels[s.getCard()]);
+        }
+        std::ranges::sort(swaps);
+        for (std::size_t i = 0; i < 8; ++i) {
+            CardStack const& s = b.field[i];
+            StackCode& code = stacks[i];
+            code.fill(0);
+            if (s.isCollapsed()) {
+                code[0] = 0xC;
+                continue;
+            }
+            std::size_t n = 0;
+            for (auto const& c : s) { code[n++] = labels[c]; }
+            code[n] = 0xF;
+        }
+        // 0xC and 0xF end a stack code, so comparing the whole arrays orders the codes as sequences
+        std::ranges::sort(stacks);
+        EndgameKey key;
+        int pos = 0;
+        auto const put = [&key, &pos](std::uint64_t nibble) {
+            assert(pos < 32);
+            ((pos < 16) ? key.low : key.high) |= nibble << (4 * (pos % 16));
+            ++pos;
+        };
+        for (auto const code : swaps) { put(code); }
+        for (auto const& code : stacks) {
+            for (auto const c : code) {
+                put(c);
+                if ((c == 0xC) || (c == 0xF)) { break; }
+            }
+        }
+        if (!best || (key < *best)) { best = key; }
+    } while (std::next_permutation(suits.begin(), suits.begin() + loose_suits));
+    return *best;
+}
+
+/** Reconstructs a board with the given EndgameKey.
+ * The suits in play are the lowest ones; collapsed suits are numbered in the order they appear.
+ */
+Board boardFromEndgameKey(EndgameKey const& key)
+{
+    int pos = 0;
+    auto const get = [&key, &pos]() -> int {
+        std::uint64_t const word = (pos < 16) ? key.low : key.high;
+        return static_cast<int>((word >> (4 * (pos++ % 16))) & 0xF);
+    };
+    std::array<int, 4> swap_codes;
+    for (auto& c : swap_codes) { c = get(); }
+    std::array<std::vector<int>, 8> stack_codes;
+    int collapsed = 0;
+    for (int const c : swap_codes) {
+        if (c == 0xC) { ++collapsed; }
+    }
+    for (auto& s : stack_codes) {
+        for (int c = get(); ; c = get()) {
+            s.push_back(c);
+            if (c == 0xC) { ++collapsed; }
+            if ((c == 0xC) || (c == 0xF)) { break; }
+        }
+    }
+    // translate into a regular board key
+    BoardKey ret;
+    int out_pos = 0;
+    auto const put = [&ret, &out_pos](int nibble) {
+        ret.words[out_pos / 16] |= static_cast<std::uint64_t>(nibble) << (4 * (out_pos % 16));
+        ++out_pos;
+    };
+    int next_collapsed = 10 - collapsed;
+    for (int const c : swap_codes) {
+        put(c);
+        if (c == 0xC) { put(next_collapsed++); }
+    }
+    for (auto const& s : stack_codes) {
+        for (int const c : s) {
+            put(c);
+            if (c == 0xC) { put(next_collapsed++); }
+        }
+    }
+    return Board::fromKey(ret);
+}
+
+/** Enumerates all boards with the given numbers of loose suits and collapsed swaps.
+ * Boards are passed to on_board without regard for duplicates.
+ */
+template<typename BoardCallback>
+void enumerateEndgames(int loose_suits, int collapsed_swaps, BoardCallback&& on_board)
+{
+    int const collapsed_stacks = 10 - loose_suits - collapsed_swaps;
+    if ((collapsed_stacks < 0) || (collapsed_stacks > 8)) { return; }
+    int const open_swaps = 4 - collapsed_swaps;
+    int const open_stacks = 8 - collapsed_stacks;
+    std::array<int, 10> remaining{};
+    for (int i = 0; i < loose_suits; ++i) { remaining[i] = 4; }
+    int const total_cards = 4 * loose_suits;
+
+    std::vector<int> swap_cards;
+    std::vector<std::vector<int>> stacks;
+    std::vector<int> current;
+
+    auto const emit = [&]() {
+        std::vector<int> swap_codes(swap_cards);
+        swap_codes.resize(open_swaps, 0xB);
+        swap_codes.resize(4, 0xC);
+        std::vector<std::vector<int>> stack_codes = stacks;
+        for (auto& s : stack_codes) { s.push_back(0xF); }
+        stack_codes.resize(open_stacks, std::vector<int>{ 0xF });
+        stack_codes.resize(8, std::vector<int>{ 0xC });
+        EndgameKey key;
+        int pos = 0;
+        auto const put = [&key, &pos](int nibble) {
+            ((pos < 16) ? key.low : key.high) |= static_cast<std::uint64_t>(nibble) << (4 * (pos % 16));
+            ++pos;
+        };
+        for (int const c : swap_codes) { put(c); }
+        for (auto const& s : stack_codes) {
+            for (int const c : s) { put(c); }
+        }
+        on_board(boardFromEndgameKey(key));
+    };
+
+    // Distributes the remaining cards over the stacks. To generate each set of stacks only once,
+    // stacks are generated in decreasing order; a stack may only be as large as the previous one.
+    auto const fill_stacks = [&](auto const& self, int cards_left) -> void {
+        if (cards_left == 0) {
+            emit();
+            return;
+        }
+        if (static_cast<int>(stacks.size()) == open_stacks) { return; }
+        // builds the next stack card by card; current is a prefix of the stack
+        auto const extend = [&](auto const& extend_self) -> void {
+            if (!current.empty() && (stacks.empty() || !(stacks.back() < current))) {
+                stacks.push_back(std::move(current));
+                current.clear();
+                self(self, cards_left - static_cast<int>(stacks.back().size()));
+                current = std::move(stacks.back());
+                stacks.pop_back();
+            }
+            for (int suit = 0; suit < loose_suits; ++suit) {
+                if (remaining[suit] == 0) { continue; }
+                current.push_back(suit);
+                // a prefix that is larger than the previous stack can not become smaller again
+                if (stacks.empty() || !(stacks.back() < current)) {
+                    --remaining[suit];
+                    extend_self(extend_self);
+                    ++remaining[suit];
+                }
+                current.pop_back();
+            }
+        };
+        extend(extend);
+    };
+
+    // the cards on the swaps, in increasing order
+    auto const fill_swaps = [&](auto const& self, int min_suit) -> void {
+        fill_stacks(fill_stacks, total_cards - static_cast<int>(swap_cards.size()));
+        if (static_cast<int>(swap_cards.size()) == open_swaps) { return; }
+        for (int suit = min_suit; suit < loose_suits; ++suit) {
+            if (remaining[suit] == 0) { continue; }
+            --remaining[suit];
+            swap_cards.push_back(suit);
+            self(self, suit);
+            swap_cards.pop_back();
+            ++remaining[suit];
+        }
+    };
+    fill_swaps(fill_swaps, 0);
+}
+}
+
+namespace {
+void encodeEndgameKey(EndgameKey const& key, std::string& out)
+{
+    for (std::uint64_t const w : { key.low, key.high }) {
+        for (int i = 0; i < 8; ++i) {
+            out.push_back(static_cast<char>((w >> (8 * i)) & 0xff));
+        }
+    }
+}
+
+EndgameKey decodeEndgameKey(std::string_view data)
+{
+    EndgameKey ret;
+    for (std::size_t i = 0; i < EndgameKeySize; ++i) {
+        ((i < 8) ? ret.low : ret.high) |= static_cast<std::uint64_t>(static_cast<std::uint8_t>(data[i])) << (8 * (i % 8));
+    }
+    return ret;
+}
+}
+
+EndgameTable::EndgameTable(MappedFile&& file, std::string_view table_records, int loose_suits)
+    :contents(std::move(file)), records(table_records), max_loose_suits(loose_suits)
+{}
+
+std::optional<std::size_t> EndgameTable::build(int loose_suits, char const* filename)
+{
+    assert((loose_suits >= 1) && (loose_suits <= MaxLooseSuits));
+    // collect all boards
+    std::vector<EndgameKey> keys;
+    std::unordered_map<EndgameKey, std::uint32_t, EndgameKeyHash> indices;
+    for (int k = 1; k <= loose_suits; ++k) {
+        for (int collapsed_swaps = 0; collapsed_swaps <= 4; ++collapsed_swaps) {
+            enumerateEndgames(k, collapsed_swaps, [&keys, &indices](Board const& b) {
+                EndgameKey const key = getEndgameKey(b);
+                if (indices.try_emplace(key, static_cast<std::uint32_t>(keys.size())).second) { keys.push_back(key); }
+            });
+        }
+    }
+
+    // the successors of each board; boards with a winning move are marked right away
+    std::uint32_t const n = static_cast<std::uint32_t>(keys.size());
+    constexpr std::uint8_t Unknown = EndgameLostDistance;
+    std::vector<std::uint8_t> distances(n, Unknown);
+    std::vector<std::uint32_t> successor_offsets;
+    successor_offsets.reserve(n + 1);
+    std::vector<std::uint32_t> successors;
+    MoveBuffer moves;
+    for (std::uint32_t i = 0; i < n; ++i) {
+        successor_offsets.push_back(static_cast<std::uint32_t>(successors.size()));
+        Board b = boardFromEndgameKey(keys[i]);
+        getAllValidMoves(b, moves);
+        for (auto const& m : moves) {
+            MoveUndo const undo = b.applyMove(m);
+            if (b.hasWon()) {
+                distances[i] = 1;
+            } else {
+                auto const it = indices.find(getEndgameKey(b));
+                assert(it != indices.end());
+                successors.push_back(it->second);
+            }
+            b.undoMove(undo);
+        }
+    }
+    successor_offsets.push_back(static_cast<std::uint32_t>(successors.size()));
+    indices.clear();
+
+    // breadth-first search backwards from the boards that are won in one move
+    std::vector<std::uint32_t> predecessor_offsets(n + 1, 0);
+    for (std::uint32_t const s : successors) { ++predecessor_offsets[s + 1]; }
+    for (std::uint32_t i = 0; i < n; ++i) { predecessor_offsets[i + 1] += predecessor_offsets[i]; }
+    std::vector<std::uint32_t> predecessors(successors.size());
+    {
+        std::vector<std::uint32_t> fill(predecessor_offsets.begin(), predecessor_offsets.end() - 1);
+        for (std::uint32_t i = 0; i < n; ++i) {
+            for (std::uint32_t j = successor_offsets[i]; j < successor_offsets[i + 1]; ++j) {
+                predecessors[fill[successors[j]]++] = i;
+            }
+        }
+    }
+    successors = {};
+    successor_offsets = {};
+    std::vector<std::uint32_t> frontier;
+    for (std::uint32_t i = 0; i < n; ++i) {
+        if (distances[i] == 1) { frontier.push_back(i); }
+    }
+    std::vector<std::uint32_t> next_frontier;
+    for (std::uint8_t distance = 2; !frontier.empty(); ++distance) {
+        if (distance == Unknown) {
+            fmt::print(stderr, "Endgame distances exceed the range of the table format.\n");
+            return std::nullopt;
+        }
+        next_frontier.clear();
+        for (std::uint32_t const i : frontier) {
+            for (std::uint32_t j = predecessor_offsets[i]; j < predecessor_offsets[i + 1]; ++j) {
+                std::uint32_t const p = predecessors[j];
+                if (distances[p] == Unknown) {
+                    distances[p] = distance;
+                    next_frontier.push_back(p);
+                }
+            }
+        }
+        std::swap(frontier, next_frontier);
+    }
+    predecessors = {};
+    predecessor_offsets = {};
+
+    // write the records sorted by key
+    std::vector<std::uint32_t> order(n);
+    for (std::uint32_t i = 0; i < n; ++i) { order[i] = i; }
+    std::ranges::sort(order, [&keys](std::uint32_t lhs, std::uint32_t rhs) { return keys[lhs] < keys[rhs]; });
+    std::FILE* fout = std::fopen(filename, "wb");
+    if (!fout) {
+        fmt::print(stderr, "Unable to open endgame table '{}' for writing.\n", filename);
+        return std::nullopt;
+    }
+    std::string out;
+    writeBinaryHeader(BinaryEndgameMagic, out);
+    out.push_back(static_cast<char>(loose_suits));
+    out.append(7, '\0');
+    bool success = true;
+    for (std::uint32_t const i : order) {
+        encodeEndgameKey(keys[i], out);
+        out.push_back(static_cast<char>(distances[i]));
+        if (out.size() >= (1 << 20)) {
+            success = success && (std::fwrite(out.data(), 1, out.size(), fout) == out.size());
+            out.clear();
+        }
+    }
+    if (!out.empty()) { success = success && (std::fwrite(out.data(), 1, out.size(), fout) == out.size()); }
+    success = (std::fclose(fout) == 0) && success;
+    if (!success) {
+        fmt::print(stderr, "Error writing endgame table '{}'.\n", filename);
+        return std::nullopt;
+    }
+    return n;
+}
+
+std::optional<EndgameTable> EndgameTable::open(char const* filename)
+{
+    auto file = MappedFile::open(filename);
+    if (!file) { return std::nullopt; }
+    auto const data = getBinaryContents(file->getContents(), BinaryEndgameMagic);
+    if (!data || (data->size() < 8) || ((data->size() - 8) % EndgameRecordSize != 0) ||
+        (static_cast<int>((*data)[0]) < 1) || (static_cast<int>((*data)[0]) > MaxLooseSuits))
+    {
+        fmt::print(stderr, "File '{}' is not an endgame table.\n", filename);
+        return std::nullopt;
+    }
+    int const loose_suits = (*data)[0];
+    std::string_view const table_records = data->substr(8);
+    return EndgameTable(std::move(*file), table_records, loose_suits);
+}
+
+std::size_t EndgameTable::size() const
+{
+    return records.size() / EndgameRecordSize;
+}
+
+std::optional<int> EndgameTable::getDistance(Board const& b) const
+{
+    auto const loose_suits = countLooseSuits(b);
+    if (!loose_suits || (*loose_suits > max_loose_suits)) { return std::nullopt; }
+    if (*loose_suits == 0) { return 0; }
+    EndgameKey const key = getEndgameKey(b);
+    std::size_t first = 0;
+    std::size_t last = size();
+    while (first < last) {
+        std::size_t const mid = first + (last - first) / 2;
+        std::string_view const record = records.substr(mid * EndgameRecordSize, EndgameRecordSize);
+        EndgameKey const mid_key = decodeEndgameKey(record);
+        if (mid_key == key) {
+            std::uint8_t const distance = static_cast<std::uint8_t>(record[EndgameKeySize]);
+            return (distance == EndgameLostDistance) ? Lost : distance;
+        }
+        if (mid_key < key) { first = mid + 1; } else { last = mid; }
+    }
+    return std::nullopt;
+}
+
+std::optional<std::vector<Move>> EndgameTable::getWinningMoves(Board b) const
+{
+    auto distance = getDistance(b);
+    if (!distance || (*distance == Lost)) { return std::nullopt; }
+    std::vector<Move> ret;
+    MoveBuffer moves;
+    while (*distance > 0) {
+        getAllValidMoves(b, moves);
+        bool found = false;
+        for (auto const& m : moves) {
+            MoveUndo const undo = b.applyMove(m);
+            auto const d = getDistance(b);
+            if (d && (*d == *distance - 1)) {
+                ret.push_back(m);
+                distance = d;
+                found = true;
+                break;
+            }
+            b.undoMove(undo);
+        }
+        // only a corrupt table lacks a move that brings us closer
+        if (!found) { return std::nullopt; }
+    }
+    return ret;
 }
@@ -0,0 +1,1281 @@
+/*
+Copyright (c) 2022 Andreas Weis (der_ghulbus@ghulbus-inc.de)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef KABUFUDA_HPP_INCLUDE_GUARD
+#define KABUFUDA_HPP_INCLUDE_GUARD
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+#include <fmt/color.h>
+
+namespace detail {
+template <class T>
+constexpr inline void hash_combine(std::size_t& seed, const T& v) noexcept
+{
+    std::hash<T> hasher;
+    seed ^= hasher(v) + 0x9e3779b9 + (seed<<6) + (seed>>2);
+}
+}
+
+/** Cards are of one of the ten suits 0-9.
+ */
+class Card {
+    int8_t c;
+
+public:
+    Card() = default;
+
+    explicit Card(int8_t card)
+        :c(card)
+    {
+        assert((c >= 0) && (c < 10));
+    }
+
+    operator int8_t() const {
+        return c;
+    }
+
+    friend bool operator==(Card const&, Card const&) = default;
+    friend bool operator!=(Card const&, Card const&) = default;
+};
+
+namespace std
+{
+template<> struct hash<Card>
+{
+    std::size_t operator()(Card const& c) const noexcept
+    {
+        std::size_t h = 0;
+        detail::hash_combine(h, c);
+        return h;
+    }
+};
+}
+
+template<>
+struct fmt::formatter<Card>
+{
+    template<typename ParseContext>
+    constexpr auto parse(ParseContext& ctx) {
+        return ctx.begin();
+    }
+
+    template<typename FormatContext>
+    auto format(Card const& c, FormatContext& ctx) const {
+        std::array<fmt::rgb, 10> palette = {
+            fmt::rgb(0xfb, 0xef, 0xcc),
+            fmt::rgb(0xf9, 0xcc, 0xac),
+            fmt::rgb(0xf4, 0xa6, 0x88),
+            fmt::rgb(0xe0, 0x87, 0x6a),
+            fmt::rgb(0xff, 0xf2, 0xdf),
+            fmt::rgb(0xd9, 0xad, 0x7c),
+            fmt::rgb(0xa2, 0x83, 0x6e),
+            fmt::rgb(0x67, 0x4d, 0x3c),
+            fmt::rgb(0xa8, 0x8f, 0xac),
+            fmt::rgb(0x82, 0x81, 0x6d)
+        };
+
+
+        fmt::fg(fmt::color());
+        return fmt::format_to(ctx.out(), fmt::fg(palette[static_cast<int8_t>(c)]), "{}", static_cast<int>(c));
+    }
+};
+
+/** A stack of cards on the board.
+ *
+ * Each consists of an arbitrary number of cards stacked on top of each other.
+ * The cards are stored inline, so copying a Board never touches the heap.
+ * Only the top cards of matching suit are accessible; the length of that run is kept up to date
+ * with every change, since move generation asks for it constantly.
+ * If a stack consists only of the four cards making up a suit, it can be collapsed.
+ * Once collapsed, the stack can not be changed anymore.
+ */
+class CardStack {
+public:
+    /** There are 40 cards in the game, so no stack can ever hold more than that.
+     */
+    static constexpr int MaxCards = 40;
+
+private:
+    std::array<Card, MaxCards> stack{};
+    std::uint8_t count = 0;
+    std::uint8_t top_size = 0;
+
+    bool is_collapsed = false;
+
+    void updateTopSize()
+    {
+        top_size = 0;
+        while ((top_size < count) && (stack[count - 1 - top_size] == stack[count - 1])) { ++top_size; }
+    }
+public:
+    CardStack() = default;
+
+    CardStack(std::initializer_list<Card>&& cards)
+    {
+        assert(cards.size() <= MaxCards);
+        for (auto const& c : cards) { stack[count++] = c; }
+        updateTopSize();
+    }
+
+    Card const& getTop() const
+    {
+        assert(count > 0);
+        return stack[count - 1];
+    }
+
+    int getTopSize() const
+    {
+        return top_size;
+    }
+
+    bool isEmpty() const {
+        return count == 0;
+    }
+
+    void pushCard(Card const& c)
+    {
+        assert(!isCollapsed());
+        assert(count < MaxCards);
+        top_size = ((count > 0) && (stack[count - 1] == c)) ? (top_size + 1) : 1;
+        stack[count++] = c;
+    }
+
+    void pushStack(Card const& c, int size)
+    {
+        assert(!isCollapsed());
+        assert(count + size <= MaxCards);
+        top_size = static_cast<std::uint8_t>((((count > 0) && (stack[count - 1] == c)) ? top_size : 0) + size);
+        for (int i = 0; i < size; ++i) {
+            stack[count++] = c;
+        }
+    }
+
+    void popCards(int size) {
+        assert(!isCollapsed());
+        assert(size <= getTopSize());
+        count -= static_cast<std::uint8_t>(size);
+        if (size < top_size) {
+            top_size -= static_cast<std::uint8_t>(size);
+        } else {
+            updateTopSize();
+        }
+    }
+
+    bool isCollapsed() const {
+        return is_collapsed;
+    }
+
+    bool tryCollapse() {
+        if ((count == 4) && (getTopSize() == 4)) {
+            is_collapsed = true;
+        }
+        return isCollapsed();
+    }
+
+    /** Reverts a successful tryCollapse().
+     */
+    void uncollapse() {
+        assert(isCollapsed());
+        is_collapsed = false;
+    }
+
+    Card const* begin() const { return stack.data(); }
+    Card const* end() const { return stack.data() + count; }
+    std::size_t size() const { return count; }
+
+    friend bool operator==(CardStack const& lhs, CardStack const& rhs) noexcept
+    {
+        return (lhs.is_collapsed == rhs.is_collapsed) &&
+               std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+    }
+    friend bool operator!=(CardStack const&, CardStack const&) noexcept = default;
+};
+
+/** A swap field (free cell) on the top of the playing board.
+ *
+ * A swap field can hold a single card, once it has been unlocked.
+ * Alternativaly it can hold a stack of four cards of the same suit,
+ * which will collapse the field and prevent any future changes to it.
+ */
+class SwapField {
+    std::optional<Card> card;
+    enum FieldState {
+        Locked,
+        Free,
+        Occupied,
+        Collapsed
+    } state;
+public:
+    SwapField()
+        :card(), state(FieldState::Locked)
+    {}
+
+    void unlock()
+    {
+        assert(state == FieldState::Locked);
+        state = FieldState::Free;
+    }
+
+    void lock()
+    {
+        assert(state == FieldState::Free);
+        state = FieldState::Locked;
+    }
+
+    bool isLocked() const
+    {
+        return state == FieldState::Locked;
+    }
+
+    bool isFree() const
+    {
+        return state == FieldState::Free;
+    }
+
+    bool isOccupied() const
+    {
+        return state == FieldState::Occupied;
+    }
+
+    bool isCollapsed() const
+    {
+        return state == FieldState::Collapsed;
+    }
+
+    void pushCard(Card const& c)
+    {
+        assert(state == FieldState::Free);
+        assert(!card);
+        card = c;
+        state = FieldState::Occupied;
+    }
+
+    void pushStack(Card const& c, int size)
+    {
+        if (size == 1) {
+            pushCard(c);
+        } else {
+            assert(size == 4);
+            pushCard(c);
+            state = FieldState::Collapsed;
+        }
+    }
+
+    Card getCard() const
+    {
+        assert((state == FieldState::Occupied) || (state == FieldState::Collapsed));
+        return *card;
+    }
+
+    void popCard()
+    {
+        assert(state == FieldState::Occupied);
+        card = std::nullopt;
+        state = FieldState::Free;
+    }
+
+    /** Reverts a pushStack().
+     * This is the only way to remove cards from a collapsed field.
+     */
+    void popStack(int size)
+    {
+        if (size == 1) {
+            popCard();
+        } else {
+            assert((size == 4) && (state == FieldState::Collapsed));
+            card = std::nullopt;
+            state = FieldState::Free;
+        }
+    }
+
+    int size() const
+    {
+        switch (state) {
+        case FieldState::Occupied: return 1;
+        case FieldState::Collapsed: return 4;
+        default: return 0;
+        }
+    }
+
+    friend bool operator==(SwapField const&, SwapField const&) noexcept = default;
+    friend bool operator!=(SwapField const&, SwapField const&) noexcept = default;
+};
+
+template<>
+struct fmt::formatter<SwapField>
+{
+    template<typename ParseContext>
+    constexpr auto parse(ParseContext& ctx)
+    {
+        return ctx.begin();
+    }
+
+    template<typename FormatContext>
+    auto format(SwapField const& s, FormatContext& ctx) const
+    {
+        if (s.isLocked()) {
+            return fmt::format_to(ctx.out(), "<X>");
+        } else if (s.isOccupied()) {
+            return fmt::format_to(ctx.out(), "<{}>", s.getCard());
+        } else if (s.isFree()) {
+            return fmt::format_to(ctx.out(), "< >");
+        } else if (s.isCollapsed()) {
+            return fmt::format_to(ctx.out(), "-{}-", s.getCard());
+        } else {
+            return fmt::format_to(ctx.out(), "@@@");
+        }
+    }
+};
+
+/** A compact, exact encoding of a Board.
+ *
+ * The board is written as a stream of 4-bit nibbles. Each swap field contributes one nibble
+ * (the card if occupied, 0xA if locked, 0xB if free, or 0xC followed by the suit if collapsed),
+ * followed by the cards of each stack in bottom-to-top order, terminated by 0xF.
+ * Collapsed stacks are written as 0xC followed by the suit instead.
+ * With 40 cards, 8 terminators and 4 swaps, the stream never exceeds 52 nibbles.
+ * Two keys compare equal iff the boards they were created from compare equal.
+ */
+struct BoardKey {
+    std::array<std::uint64_t, 4> words{};
+
+    friend bool operator==(BoardKey const&, BoardKey const&) noexcept = default;
+    friend bool operator!=(BoardKey const&, BoardKey const&) noexcept = default;
+};
+
+namespace std
+{
+template<> struct hash<BoardKey>
+{
+    std::size_t operator()(BoardKey const& k) const noexcept
+    {
+        // multiply-xorshift mixing of all words; the final avalanche step is taken from splitmix64
+        std::uint64_t h = 0;
+        for (auto const w : k.words) {
+            h = (h ^ w) * 0x9e3779b97f4a7c15ull;
+            h ^= h >> 29;
+        }
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+        return static_cast<std::size_t>(h ^ (h >> 31));
+    }
+};
+}
+
+enum class Difficulty {
+    Easy,       // 4 free swaps
+    Normal,     // 3 free swaps
+    Hard,       // 2 free swaps
+    Expert      // 1 free swap
+};
+
+/** A move takes 1-4 cards from one place to another.
+ * The to and from fields contain an index to a card stack or swap field on the board.
+ * Card Stacks are indexed left-to-right by the positive indices [0..8).
+ * Swap Fields are indexed right-to-left by the negative indices [-4..-1]
+ */
+struct Move {
+    int from;
+    int to;
+    int size;
+
+    friend bool operator==(Move const&, Move const&) noexcept = default;
+};
+
+/** Everything needed to revert a Move that was applied to a Board in-place.
+ */
+struct MoveUndo {
+    Move move;
+    /// A stack collapsed as a result of the move.
+    bool collapsed;
+    /// The collapse unlocked a swap field.
+    bool unlocked_swap;
+};
+
+/** The playing board, consisting of 8 card stacks and 4 swap fields.
+ */
+class Board {
+public:
+    std::array<SwapField, 4> swaps;
+    std::array<CardStack, 8> field;
+
+private:
+    static int swapIndex(int i) {
+        assert((i >= -4) && (i < 0));
+        return (-i) - 1;
+    }
+public:
+
+    Board(Difficulty d)
+    {
+        int const free_swaps = [](Difficulty d) {
+            switch (d) {
+            case Difficulty::Easy:      return 4;
+            case Difficulty::Normal:    return 3;
+            case Difficulty::Hard:      return 2;
+            default:                    return 1;
+            }
+        }(d);
+        for (int i = 0; i < free_swaps; ++i) { unlockSwap(); }
+    }
+
+    Board()
+        :Board(Difficulty::Expert)
+    {}
+
+    bool unlockSwap()
+    {
+        for (int i = 0, i_end = static_cast<int>(swaps.size()); i != i_end; ++i) {
+            SwapField& swap = swaps[i];
+            if (swap.isLocked()) {
+                swap.unlock();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /** Number of swap fields that have been unlocked.
+     * Swaps are unlocked from left to right, so these are the swaps with indices -1 to -count.
+     */
+    int getUnlockedSwapCount() const
+    {
+        return static_cast<int>(std::ranges::count_if(swaps, [](SwapField const& s) { return !s.isLocked(); }));
+    }
+
+    /** Reverts the most recent unlockSwap().
+     */
+    void lockSwap()
+    {
+        // swaps are unlocked from left to right, so the last unlocked swap is the most recent one
+        for (int i = static_cast<int>(swaps.size()) - 1; i >= 0; --i) {
+            SwapField& swap = swaps[i];
+            if (!swap.isLocked()) {
+                swap.lock();
+                return;
+            }
+        }
+        assert(false);
+    }
+
+    /** Executes a move in-place.
+     * @return Information required for reverting the move with undoMove().
+     */
+    MoveUndo applyMove(Move const& m);
+
+    /** Reverts a move previously executed with applyMove().
+     * Moves must be reverted in the reverse order in which they were applied.
+     */
+    void undoMove(MoveUndo const& u);
+
+    bool isValid() const
+    {
+        // there should be 40 cards in total
+        int const cards_total =
+            std::accumulate(begin(field), end(field), 0, [](int acc, CardStack const& s) { return acc + static_cast<int>(s.size()); }) +
+            std::accumulate(begin(swaps), end(swaps), 0, [](int acc, SwapField const& s) { return acc + s.size(); });
+        if (cards_total != 40) { fmt::print(stderr, "Invalid card total. Expected: 40. Found: {}.\n", cards_total); return false; }
+
+        // for each of the 10 suits we should have exactly 4 cards on the board
+        bool is_valid = true;
+        for (int i = 0; i < 10; ++i) {
+            Card const c = Card{ static_cast<int8_t>(i) };
+            int count = 0;
+            for (auto const& s : field) {
+                count += static_cast<int>(std::ranges::count(s, c));
+            }
+            for (auto const& s : swaps) {
+                if (s.isOccupied()) {
+                    if (c == s.getCard()) { ++count; }
+                } else if (s.isCollapsed()) {
+                    if (c == s.getCard()) { count += 4; }
+                }
+            }
+            if (count != 4) { fmt::print(stderr, "Invalid count for suit {}. Expected: 4. Found: {}.\n", i, count); is_valid = false; }
+        }
+        return is_valid;
+    }
+
+    bool hasWon() const
+    {
+        // we have won if there are no cards on the board that are not part of a collapsed field
+        for (auto const& s : field) {
+            if (!s.isEmpty() && !s.isCollapsed()) { return false; }
+        }
+        for (auto const& s : swaps) {
+            if (s.isOccupied()) { return false; }
+        }
+        return true;
+    }
+
+    int getMaxSize() const
+    {
+        auto const size_compare = [](CardStack const& s1, CardStack const& s2) { return s1.size() < s2.size(); };
+        return static_cast<int>(std::ranges::max(field, size_compare).size());
+    }
+
+    CardStack& getField(int index)
+    {
+        assert((index >= 0) && (index < 8));
+        return field[index];
+    }
+
+    CardStack const& getField(int index) const
+    {
+        assert((index >= 0) && (index < 8));
+        return field[index];
+    }
+
+    SwapField& getSwap(int index)
+    {
+        return swaps[swapIndex(index)];
+    }
+
+    SwapField const& getSwap(int index) const
+    {
+        return swaps[swapIndex(index)];
+    }
+
+    BoardKey getKey() const
+    {
+        return writeKey({ 0, 1, 2, 3 }, { 0, 1, 2, 3, 4, 5, 6, 7 });
+    }
+
+    /** Reconstructs the board from which a key was created with getKey().
+     */
+    static Board fromKey(BoardKey const& key)
+    {
+        Board ret;
+        ret.swaps.fill(SwapField{});
+        int pos = 0;
+        auto const get = [&key, &pos]() -> std::int8_t {
+            auto const nibble = (key.words[pos / 16] >> (4 * (pos % 16))) & 0xF;
+            ++pos;
+            return static_cast<std::int8_t>(nibble);
+        };
+        for (auto& s : ret.swaps) {
+            std::int8_t const code = get();
+            if (code == 0xA) { continue; }
+            s.unlock();
+            if (code == 0xC) {
+                s.pushStack(Card{ get() }, 4);
+            } else if (code != 0xB) {
+                s.pushCard(Card{ code });
+            }
+        }
+        for (auto& s : ret.field) {
+            for (std::int8_t code = get(); code != 0xF; code = get()) {
+                if (code == 0xC) {
+                    s.pushStack(Card{ get() }, 4);
+                    s.tryCollapse();
+                    break;
+                }
+                s.pushCard(Card{ code });
+            }
+        }
+        return ret;
+    }
+
+    /** Key that is identical for all boards that only differ by the order of their stacks and swaps.
+     *
+     * Neither the position of a stack on the field nor that of a swap field affects which moves
+     * are possible, so boards with the same canonical key are equivalent for the search.
+     */
+    BoardKey getCanonicalKey() const
+    {
+        std::array<int, 4> swap_order = { 0, 1, 2, 3 };
+        std::array<int, 8> field_order = { 0, 1, 2, 3, 4, 5, 6, 7 };
+        std::ranges::sort(swap_order, [this](int lhs, int rhs) { return swapCode(swaps[lhs]) < swapCode(swaps[rhs]); });
+        std::ranges::sort(field_order, [this](int lhs, int rhs) {
+            CardStack const& s1 = field[lhs];
+            CardStack const& s2 = field[rhs];
+            if (s1.isCollapsed() != s2.isCollapsed()) { return s1.isCollapsed(); }
+            return std::lexicographical_compare(s1.begin(), s1.end(), s2.begin(), s2.end());
+        });
+        return writeKey(swap_order, field_order);
+    }
+
+private:
+    static int swapCode(SwapField const& s)
+    {
+        if (s.isLocked()) { return 0xA; }
+        if (s.isFree()) { return 0xB; }
+        if (s.isOccupied()) { return s.getCard(); }
+        return 0xC0 | s.getCard();
+    }
+
+    BoardKey writeKey(std::array<int, 4> const& swap_order, std::array<int, 8> const& field_order) const
+    {
+        BoardKey ret;
+        int pos = 0;
+        auto const put = [&ret, &pos](int nibble) {
+            ret.words[pos / 16] |= static_cast<std::uint64_t>(nibble) << (4 * (pos % 16));
+            ++pos;
+        };
+        for (int i : swap_order) {
+            int const code = swapCode(swaps[i]);
+            if (code > 0xF) { put(code >> 4); }
+            put(code & 0xF);
+        }
+        for (int i : field_order) {
+            CardStack const& s = field[i];
+            if (s.isCollapsed()) {
+                put(0xC);
+                put(s.getTop());
+            } else {
+                for (auto const& c : s) { put(c); }
+                put(0xF);
+            }
+        }
+        assert(pos <= 64);
+        return ret;
+    }
+
+public:
+    friend bool operator==(Board const&, Board const&) noexcept = default;
+    friend bool operator!=(Board const&, Board const&) noexcept = default;
+};
+
+namespace std
+{
+template<> struct hash<Board>
+{
+    std::size_t operator()(Board const& b) const noexcept
+    {
+        return std::hash<BoardKey>{}(b.getKey());
+    }
+};
+}
+
+template<>
+struct fmt::formatter<Board>
+{
+    template<typename ParseContext>
+    constexpr auto parse(ParseContext& ctx)
+    {
+        return ctx.begin();
+    }
+
+    template<typename FormatContext>
+    auto format(Board const& b, FormatContext& ctx) const {
+        // print swaps
+        fmt::format_to(ctx.out(), "Swaps: ");
+        for (auto const& s : b.swaps) {
+            fmt::format_to(ctx.out(), "{} ", s);
+        }
+        fmt::format_to(ctx.out(), "\n");
+        // print stacks
+        int max_depth = b.getMaxSize();
+        for (int i = 0; i < max_depth; ++i) {
+            for (auto const& s : b.field) {
+                fmt::format_to(ctx.out(), " ");
+                if (static_cast<std::size_t>(i) < s.size()) {
+                    if (s.isCollapsed()) {
+                        fmt::format_to(ctx.out(), "-{}-", *(s.begin() + i));
+                    } else {
+                        fmt::format_to(ctx.out(), " {} ", *(s.begin() + i));
+                    }
+                } else {
+                    fmt::format_to(ctx.out(), "   ");
+                }
+            }
+            fmt::format_to(ctx.out(), "\n");
+        }
+        return ctx.out();
+    }
+};
+
+/** Read-only view of the complete contents of a file.
+ *
+ * Regular files are memory-mapped. Other files, like pipes, are read into a buffer instead.
+ * The contents stay at the same address when a MappedFile is moved.
+ */
+class MappedFile {
+    char const* mapped_data = nullptr;
+    std::size_t mapped_size = 0;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#endif
+    std::vector<char> buffer;
+
+    MappedFile() = default;
+    void unmap();
+public:
+    ~MappedFile();
+    MappedFile(MappedFile&& rhs) noexcept;
+    MappedFile& operator=(MappedFile&& rhs) noexcept;
+
+    /** Opens a file for reading.
+     * Errors are reported to stderr.
+     */
+    static std::optional<MappedFile> open(char const* filename);
+
+    /** Reads everything from standard input.
+     */
+    static MappedFile readStdin();
+
+    std::string_view getContents() const {
+        return mapped_data ? std::string_view(mapped_data, mapped_size) : std::string_view(buffer.data(), buffer.size());
+    }
+};
+
+/** Location and description of an error in a puzzle input.
+ * Lines and columns are counted from 1.
+ */
+struct ParseError {
+    std::size_t line;
+    std::size_t column;
+    std::string_view message;
+};
+
+/** Parses a puzzle in the text format described in the README.
+ * Lines consist of either 8 cards separated by whitespace, or one of the difficulties Easy, Medium, Hard, Expert.
+ * Exactly 5 lines of cards and at most one difficulty are expected; blank lines are ignored.
+ * @param[in] input The puzzle input.
+ * @param[out] error If non-null, receives the first error in input. Otherwise errors are reported to stderr.
+ * @return The parsed board, or an empty board if input is malformed.
+ *         The returned board should be checked with Board::isValid().
+ */
+Board parseBoard(std::string_view input, ParseError* error = nullptr);
+
+/** Splits a stream of concatenated puzzle inputs into the inputs of the individual puzzles.
+ *
+ * Each puzzle consists of 5 lines of cards, optionally followed by a line with the difficulty.
+ * Blank lines between puzzles are ignored.
+ */
+std::vector<std::string_view> splitPuzzles(std::string_view input);
+
+/** Writes an initial board in the text format read by parseBoard().
+ */
+void formatPuzzleText(Board const& b, std::string& out);
+
+/** Deals a random puzzle by shuffling the 40 cards onto the 8 stacks.
+ *
+ * Each deal is determined by seed and index alone, so deals can be reproduced individually
+ * and generated in any order. The same deals are produced on every platform.
+ */
+Board generateDeal(std::uint64_t seed, std::uint64_t index, Difficulty difficulty);
+
+bool isFieldIndex(int i);
+bool isSwapIndex(int i);
+
+template<>
+struct fmt::formatter<Move>
+{
+    /// Format as from>to*size, selected with {:c}
+    bool compact = false;
+
+    template<typename ParseContext>
+    constexpr auto parse(ParseContext& ctx)
+    {
+        auto it = ctx.begin();
+        if ((it != ctx.end()) && (*it == 'c')) {
+            compact = true;
+            ++it;
+        }
+        return it;
+    }
+
+    template<typename FormatContext>
+    auto format(Move const& m, FormatContext& ctx) const
+    {
+        if (compact) {
+            return fmt::format_to(ctx.out(), "{}>{}*{}", m.from, m.to, m.size);
+        }
+        return fmt::format_to(ctx.out(), "{} card{} from {} -> {}", m.size, (m.size == 1) ? "" : "s", m.from, m.to);
+    }
+};
+
+/** Checks whether a move is well-formed, independent of any board.
+ */
+bool moveIsValid(Move const& m);
+
+/** Checks whether a move can be made on a board.
+ */
+bool moveIsValidForBoard(Board const& b, Move const& m);
+
+Board executeMove(Board b, Move const& m);
+
+/** Binary puzzle and solution files.
+ *
+ * Both kinds of file start with an 8 byte header: a 4 byte magic number, a version byte and 3 zero bytes.
+ *
+ * A puzzle file contains fixed-size records of BinaryPuzzleRecordSize bytes each, so it can
+ * be memory-mapped and indexed directly. The first 20 bytes of a record hold the 40 cards at 4 bits each,
+ * stack by stack from bottom to top, with the first card of each byte in the lower nibble.
+ * The last byte is the difficulty: 0 Easy, 1 Medium, 2 Hard, 3 Expert.
+ *
+ * A solution file contains one record per puzzle: a status byte (BinarySolutionStatus),
+ * the number of moves as 2 byte little endian, and 3 bytes per move for from, to and size.
+ */
+constexpr std::size_t BinaryHeaderSize = 8;
+constexpr std::size_t BinaryPuzzleRecordSize = 21;
+constexpr std::size_t BinaryMoveSize = 3;
+constexpr std::string_view BinaryPuzzleMagic = "KBFP";
+constexpr std::string_view BinarySolutionMagic = "KBFS";
+constexpr std::string_view BinaryCacheMagic = "KBFC";
+constexpr std::string_view BinaryEndgameMagic = "KBFE";
+constexpr std::uint8_t BinaryFormatVersion = 1;
+/// Version of the solution cache format, whose records carry a flags byte since version 2.
+constexpr std::uint8_t BinaryCacheVersion = 2;
+
+enum class BinarySolutionStatus : std::uint8_t {
+    Unsolvable = 0,
+    Solved = 1,
+    Invalid = 2,
+    GaveUp = 3
+};
+
+void writeBinaryHeader(std::string_view magic, std::string& out, std::uint8_t version = BinaryFormatVersion);
+
+/** Checks the header of a binary file.
+ * @return The contents following the header, or std::nullopt if the header does not match magic and version.
+ */
+std::optional<std::string_view> getBinaryContents(std::string_view file_contents, std::string_view magic,
+                                                  std::uint8_t version = BinaryFormatVersion);
+
+/** Appends an initial board as a binary puzzle record.
+ */
+void encodeBinaryPuzzle(Board const& b, std::string& out);
+
+/** Decodes a binary puzzle record of BinaryPuzzleRecordSize bytes.
+ * @return The decoded board, or an empty board if the record is malformed.
+ */
+Board decodeBinaryPuzzle(std::string_view record);
+
+/** Appends a binary solution record.
+ */
+void encodeBinarySolution(BinarySolutionStatus status, std::vector<Move> const& moves, std::string& out);
+
+/** Decodes the binary solution record at the start of data.
+ * @return The size of the record in bytes, or 0 if data does not start with a complete record.
+ */
+std::size_t decodeBinarySolution(std::string_view data, BinarySolutionStatus& status, std::vector<Move>& moves);
+
+/** Fixed-capacity list of moves that can be filled without allocating.
+ */
+class MoveBuffer {
+public:
+    /// Moves between any two of the 12 slots with up to 4 cards each.
+    static constexpr std::size_t Capacity = 12 * 12 * 4;
+private:
+    std::array<Move, Capacity> moves;
+    std::size_t count = 0;
+public:
+    void clear() {
+        count = 0;
+    }
+
+    void push_back(Move const& m) {
+        assert(count < Capacity);
+        moves[count++] = m;
+    }
+
+    std::size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    Move const& operator[](std::size_t i) const {
+        assert(i < count);
+        return moves[i];
+    }
+
+    Move* begin() { return moves.data(); }
+    Move* end() { return moves.data() + count; }
+    Move const* begin() const { return moves.data(); }
+    Move const* end() const { return moves.data() + count; }
+
+    /** Removes all moves for which the predicate returns true, preserving the order of the remaining moves.
+     */
+    template<typename Predicate>
+    void eraseIf(Predicate&& p) {
+        count = static_cast<std::size_t>(std::remove_if(begin(), end(), std::forward<Predicate>(p)) - begin());
+    }
+};
+
+/** Generates all valid moves for a board, moves with more cards first.
+ */
+void getAllValidMoves(Board const& b, MoveBuffer& ret);
+std::vector<Move> getAllValidMoves(Board const& b);
+
+/** Rules for discarding moves that can never be required for finding a solution.
+ */
+enum class PruningRule {
+    RunToEmpty,     ///< Moving a stack that consists of a single run of fewer than four cards onto an empty stack only moves it elsewhere.
+    SwapToSwap,     ///< Moving a card between two swaps only moves it elsewhere.
+    SplitRun,       ///< Moving only part of a run onto a stack of the same suit is never better than moving all of it.
+    Reversal,       ///< Taking back the previous move leads to a board that is already being explored.
+    Count
+};
+
+constexpr std::size_t PruningRuleCount = static_cast<std::size_t>(PruningRule::Count);
+
+constexpr std::array<std::string_view, PruningRuleCount> pruning_rule_names = {
+    "run-to-empty", "swap-to-swap", "split-run", "reversal"
+};
+
+using PruningRules = std::array<bool, PruningRuleCount>;
+
+constexpr PruningRules AllPruningRules = { true, true, true, true };
+
+/** Number of moves removed by each of the pruning rules.
+ */
+struct PruningStats {
+    std::array<std::uint64_t, PruningRuleCount> removed_moves{};
+};
+
+/** Removes all moves from a list of valid moves that are made redundant by one of the enabled rules.
+ * @param[in] b Board for which the moves were generated.
+ * @param[in,out] moves Valid moves for b.
+ * @param[in] last_move The move that led to b, or nullptr if b is the initial board.
+ * @param[in] rules The rules to apply.
+ * @param[in,out] stats Receives the number of moves removed by each rule.
+ */
+void pruneMoves(Board const& b, MoveBuffer& moves, MoveUndo const* last_move, PruningRules const& rules, PruningStats& stats);
+
+/** Lower bound for the number of moves required to win from a board.
+ *
+ * Each of the suits that have not been collapsed yet is spread over a number of groups,
+ * where a group is either a run of cards on a stack or a single card on a swap.
+ * Since every move only involves cards of a single suit and can join at most two groups,
+ * a suit with n groups requires at least n - 1 further moves, and at least one move in any case.
+ * No move changes the estimate by more than one, so the estimate is consistent.
+ */
+int estimateRemainingMoves(Board const& b);
+
+int countFreeSwaps(Board const& b);
+
+/** Checks whether a board can be proven lost without searching.
+ *
+ * Only boards without a free swap and without an empty stack are examined. On these,
+ * the only possible moves put a run onto a run of the same suit, which never creates
+ * free space by itself. The check digs through the stacks, generously assuming
+ * that every run can be moved away whenever its suit is showing on another stack as well,
+ * and reports a dead end if this can neither free a stack or swap nor bring the four cards
+ * of any suit within reach of each other.
+ * @return true if the board can not be won. false does not mean that it can be won.
+ */
+bool isDeadEnd(Board const& b);
+
+/** Order in which the depth-first searches try the moves of a board.
+ */
+enum class MoveOrdering {
+    Size,       ///< Moves with more cards first, as generated by getAllValidMoves().
+    Heuristic,  ///< Moves that collapse a suit first, then by size; among moves of the same size,
+                ///  moves that empty a stack or uncover a card that can join another stack come first.
+    History     ///< Like Heuristic, but ties are broken by how often the same kind of move led to collapses earlier in the search.
+};
+
+/** Rearranges the moves for a board according to a static move ordering.
+ * Moves that compare equal under the ordering keep their relative order.
+ * @param[in] b Board for which the moves were generated.
+ * @param[in,out] moves Valid moves for b, in the order of getAllValidMoves().
+ * @param[in] ordering The ordering to apply; MoveOrdering::History needs the state of a search
+ *                     and is treated like MoveOrdering::Heuristic.
+ */
+void orderMoves(Board const& b, MoveBuffer& moves, MoveOrdering ordering);
+
+enum class SearchStrategy {
+    DepthFirst,     ///< Depth-first backtracking; finds a solution quickly, but usually not a short one.
+    AStar,          ///< Best-first search guided by estimateRemainingMoves().
+    IterativeDeepening, ///< IDA* search guided by estimateRemainingMoves(); uses memory only for the current path and a bounded cache.
+    Anytime         ///< Depth-first search that goes on looking for shorter solutions by branch and bound until a limit is reached.
+};
+
+/** Counters collected during a search.
+ */
+struct SearchStats {
+    /// Number of boards for which moves were generated.
+    std::uint64_t nodes_expanded = 0;
+    /// Number of valid moves generated, before pruning.
+    std::uint64_t moves_generated = 0;
+    /// Number of moves that led to a board that had been visited before.
+    std::uint64_t duplicates = 0;
+    /// Largest number of moves between the initial board and any board visited.
+    std::uint64_t peak_depth = 0;
+    /// Largest number of boards held in the visited set.
+    std::uint64_t peak_visited_boards = 0;
+    /// Largest amount of memory used by the visited set, in bytes.
+    std::uint64_t peak_visited_bytes = 0;
+    /// Time spent searching so far.
+    std::chrono::steady_clock::duration elapsed{};
+    /// Number of boards discarded because isDeadEnd() proved them lost.
+    std::uint64_t dead_ends = 0;
+    /// Number of boards found in SolverOptions::endgame.
+    std::uint64_t endgame_hits = 0;
+    /// Number of moves removed from the solution by shortenSolution().
+    std::uint64_t moves_shortened = 0;
+    /// Number of moves removed by each of the pruning rules.
+    PruningStats pruning;
+
+    double getNodesPerSecond() const
+    {
+        double const seconds = std::chrono::duration<double>(elapsed).count();
+        return (seconds > 0.0) ? (static_cast<double>(nodes_expanded) / seconds) : 0.0;
+    }
+
+    /** Adds the counters of other to this, and takes the maximum of the peak values.
+     * The elapsed time is not changed.
+     */
+    void merge(SearchStats const& other)
+    {
+        nodes_expanded += other.nodes_expanded;
+        moves_generated += other.moves_generated;
+        duplicates += other.duplicates;
+        dead_ends += other.dead_ends;
+        endgame_hits += other.endgame_hits;
+        moves_shortened += other.moves_shortened;
+        peak_depth = std::max(peak_depth, other.peak_depth);
+        peak_visited_boards = std::max(peak_visited_boards, other.peak_visited_boards);
+        peak_visited_bytes = std::max(peak_visited_bytes, other.peak_visited_bytes);
+        for (std::size_t i = 0; i < PruningRuleCount; ++i) { pruning.removed_moves[i] += other.pruning.removed_moves[i]; }
+    }
+};
+
+class SolutionCache;
+class EndgameTable;
+
+/** Options controlling the search performed by solve().
+ */
+struct SolverOptions {
+    SearchStrategy strategy = SearchStrategy::DepthFirst;
+    /// Weight of the heuristic for SearchStrategy::AStar and SearchStrategy::IterativeDeepening.
+    /// A weight of 1 finds a shortest solution; larger weights trade solution length for speed, finding solutions
+    /// at most this many times as long as a shortest one. At the default weight, the first IterativeDeepening bound
+    /// usually admits the first path tried, which makes it behave much like SearchStrategy::DepthFirst.
+    double heuristic_weight = 2.0;
+    /// Treat boards that only differ by a permutation of stacks or swaps as the same position.
+    bool canonicalize = false;
+    /// Upper limit in bytes for the memory used to remember visited boards. 0 means unlimited.
+    /// SearchStrategy::AStar also has to keep every node it generated, so it gives up with SearchLimit::Memory
+    /// once its visited set and nodes together use this many bytes, or 1 GiB if no limit is given.
+    std::size_t max_visited_bytes = 0;
+    /// Rules used for discarding redundant moves.
+    PruningRules pruning = AllPruningRules;
+    /// Order of the moves tried by the depth-first strategies; has no effect on SearchStrategy::AStar.
+    MoveOrdering move_ordering = MoveOrdering::Heuristic;
+    /// Discard boards that isDeadEnd() proves lost, instead of searching them.
+    bool detect_dead_ends = true;
+    /// Number of threads for SearchStrategy::DepthFirst.
+    std::size_t threads = 1;
+    /// If set, invoked with the statistics of the running search about every progress_interval.
+    /// With multiple threads, it may be invoked from any of the search threads, but never concurrently.
+    std::function<void(SearchStats const&)> progress;
+    std::chrono::milliseconds progress_interval{ 1000 };
+    /// The search gives up after this much time. 0 means unlimited.
+    std::chrono::milliseconds time_limit{ 0 };
+    /// The search gives up after expanding this many nodes. 0 means unlimited.
+    std::uint64_t max_nodes = 0;
+    /// The search gives up once the visited set and the search storage use more than this many bytes. 0 means unlimited.
+    std::size_t max_memory_bytes = 0;
+    /// If set, boards are looked up in the cache before searching, and new results are stored in it.
+    SolutionCache* cache = nullptr;
+    /// If set, boards covered by the table are finished with its exact distances instead of being searched further.
+    EndgameTable const* endgame = nullptr;
+    /// SearchStrategy::Anytime invokes this with each solution that is shorter than all those found before.
+    std::function<void(std::vector<Move> const&)> on_solution;
+    /// Pass solutions found through shortenSolution() with the given search depth.
+    bool shorten_solutions = true;
+    int shorten_depth = 2;
+};
+
+/** The limits of SolverOptions that can make a search give up.
+ */
+enum class SearchLimit {
+    None,
+    Time,
+    Nodes,
+    Memory
+};
+
+enum class SolveStatus {
+    Solved,         ///< A solution was found.
+    Unsolvable,     ///< The search was exhaustive and did not find a solution.
+    GaveUp          ///< The search was stopped by one of the limits before it found a solution.
+};
+
+/** Outcome of Solver::solve().
+ */
+struct SolveResult {
+    SolveStatus status = SolveStatus::Unsolvable;
+    /// If status is SolveStatus::GaveUp, the limit that stopped the search.
+    SearchLimit exceeded_limit = SearchLimit::None;
+    /// The winning moves; empty if no solution was found or the board had already been won.
+    std::vector<Move> moves;
+    /// Statistics of the search.
+    SearchStats stats;
+    /// The result was taken from SolverOptions::cache without searching.
+    bool from_cache = false;
+    /// The search proved that no shorter solution exists.
+    bool is_shortest = false;
+};
+
+/** Solves puzzles in-process.
+ *
+ * A solver keeps the hash tables and search storage of previous searches around,
+ * so solving many puzzles with one solver avoids allocating them again for each puzzle.
+ * A solver may only be used by one thread at a time; use one solver per thread
+ * to solve puzzles concurrently.
+ */
+class Solver {
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+public:
+    explicit Solver(SolverOptions const& options = SolverOptions{});
+    ~Solver();
+    Solver(Solver&&) noexcept;
+    Solver& operator=(Solver&&) noexcept;
+
+    SolverOptions const& getOptions() const;
+    void setOptions(SolverOptions const& options);
+
+    /** Searches for a sequence of moves that wins the game from the given board.
+     */
+    SolveResult solve(Board const& b);
+};
+
+/** Shortens a winning sequence of moves without searching the whole game again.
+ *
+ * Three passes are repeated until none of them finds an improvement: moves between two visits of the same
+ * board are removed, consecutive moves between the same two places are merged into one, and a search of
+ * limited depth from each board of the solution looks for a shorter way to any of the later boards.
+ * @param[in] b Board from which moves win the game.
+ * @param[in] moves Winning moves for b.
+ * @param[in] search_depth Largest number of moves tried from each board; 0 skips the search.
+ *                         The cost of the search grows exponentially with the depth.
+ * @return Winning moves for b, no more than the given ones.
+ */
+std::vector<Move> shortenSolution(Board const& b, std::vector<Move> moves, int search_depth);
+
+/** Table of exact distances to a win for boards with only a few suits left.
+ *
+ * Once all but a few suits have been collapsed, the remaining boards are few enough to analyze them all in advance.
+ * build() enumerates every such board, up to the order of the stacks and swaps and the naming of the suits,
+ * and determines the fewest moves required to win from each one by a breadth-first search backwards from the won boards.
+ * The file starts with a binary header with BinaryEndgameMagic, followed by the largest number of suits covered
+ * and 7 zero bytes, followed by records of a 16 byte key and 1 byte distance, sorted by key.
+ * The file is memory-mapped and searched in place.
+ */
+class EndgameTable {
+    MappedFile contents;
+    std::string_view records;
+    int max_loose_suits;
+
+    EndgameTable(MappedFile&& file, std::string_view table_records, int loose_suits);
+public:
+    /// Distance reported for boards that can not be won.
+    static constexpr int Lost = -1;
+    /// Largest number of remaining suits supported by build().
+    static constexpr int MaxLooseSuits = 3;
+
+    /** Builds the table for all boards with up to loose_suits suits that have not been collapsed, and writes it to a file.
+     * Building with 3 suits covers about 740000 boards and takes in the order of half a minute.
+     * Errors are reported to stderr.
+     * @return The number of boards in the table, or std::nullopt if the file could not be written.
+     */
+    static std::optional<std::size_t> build(int loose_suits, char const* filename);
+
+    /** Opens a table written by build().
+     * Errors are reported to stderr.
+     */
+    static std::optional<EndgameTable> open(char const* filename);
+
+    int getMaxLooseSuits() const {
+        return max_loose_suits;
+    }
+
+    std::size_t size() const;
+
+    /** Retrieves the number of moves required to win from a board.
+     * @return The distance, Lost, or std::nullopt if the table does not cover the board.
+     */
+    std::optional<int> getDistance(Board const& b) const;
+
+    /** Retrieves a shortest sequence of moves that wins from a board covered by the table.
+     * @return The winning moves, or std::nullopt if the board is not covered or can not be won.
+     */
+    std::optional<std::vector<Move>> getWinningMoves(Board b) const;
+};
+
+/** Persistent cache of the results for initial boards.
+ *
+ * Boards are identified by their canonical key, so a deal is found again even if its stacks
+ * were dealt in a different order. The cache file starts with a binary header with BinaryCacheMagic,
+ * followed by one record per board: the 32 byte canonical key, a flags byte, and a binary solution record
+ * whose moves refer to the stacks and swaps in canonical order. Bit 0 of the flags is SolveResult::is_shortest.
+ * Existing records are memory-mapped; new results are appended to the file as soon as they are stored,
+ * so the cache survives crashes and can be shared by consecutive runs.
+ * Only solved and unsolvable results are cached. All member functions may be called concurrently.
+ */
+class SolutionCache {
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+
+    SolutionCache();
+public:
+    ~SolutionCache();
+    SolutionCache(SolutionCache&&) noexcept;
+    SolutionCache& operator=(SolutionCache&&) noexcept;
+
+    /** Opens a cache file, creating it if it does not exist.
+     * Errors are reported to stderr.
+     */
+    static std::optional<SolutionCache> open(char const* filename);
+
+    /** Retrieves the result for an initial board, with the moves mapped to the stacks of b.
+     * Cached solutions are replayed on b before they are returned.
+     */
+    std::optional<SolveResult> lookup(Board const& b) const;
+
+    /** Stores the result for an initial board, unless the cache already has one that is at least as good.
+     * A result is better than the cached one if it is a shortest solution and the cached one is not.
+     * Results of searches that gave up are ignored, as are boards with cards on swaps or collapsed stacks.
+     */
+    void store(Board const& b, SolveResult const& result);
+
+    /** Number of boards in the cache.
+     */
+    std::size_t size() const;
+};
+
+#endif
@@ -0,0 +1,959 @@
+/*
+Copyright (c) 2022 Andreas Weis (der_ghulbus@ghulbus-inc.de)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <kabufuda.hpp>
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <thread>
+
+#ifdef _WIN32
+#   include <fcntl.h>
+#   include <io.h>
+#else
+#   include <sys/socket.h>
+#   include <sys/un.h>
+#   include <unistd.h>
+#endif
+
+template<typename T>
+std::optional<T> parseNumber(std::string_view str)
+{
+    T ret;
+    auto const [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), ret);
+    if ((ec != std::errc{}) || (ptr != str.data() + str.size())) { return std::nullopt; }
+    return ret;
+}
+
+/** What to print after solving a single puzzle.
+ */
+enum class OutputMode {
+    Text,       ///< The winning moves and statistics in human-readable form.
+    Replay,     ///< Like Text, followed by the board after each of the winning moves.
+    Moves,      ///< Only the winning moves, one per line, formatted as from>to*size.
+    Json,       ///< The result and statistics as a single JSON object.
+    None        ///< Nothing; only the exit code tells whether a solution was found.
+};
+
+struct CommandLine {
+    SolverOptions options;
+    OutputMode output = OutputMode::Text;
+    /// Print the search statistics to stderr in regular intervals.
+    bool progress = false;
+    /// Solve all puzzles from all inputs, printing one line per puzzle.
+    bool batch = false;
+    /// Number of puzzles solved concurrently in batch mode.
+    std::size_t jobs = 1;
+    /// Read puzzles in the binary puzzle format instead of text.
+    bool binary_input = false;
+    /// Write results in the binary solution format, or converted puzzles in the binary puzzle format.
+    bool binary_output = false;
+    /// Write the input puzzles in the output format instead of solving them.
+    bool convert = false;
+    /// File receiving the batch output instead of standard output.
+    std::string output_file;
+    /// Solution cache file; empty if no cache is used.
+    std::string cache_file;
+    /// Endgame table file; empty if no table is used.
+    std::string endgame_file;
+    /// Build an endgame table and write it to endgame_file instead of solving.
+    bool build_endgame = false;
+    /// Number of remaining suits up to which a built endgame table covers boards.
+    int endgame_suits = EndgameTable::MaxLooseSuits;
+    /// Number of random deals to solve in addition to the inputs.
+    std::uint64_t generate = 0;
+    std::uint64_t seed = 0;
+    /// Difficulty of the random deals; std::nullopt cycles through all difficulties.
+    std::optional<Difficulty> difficulty = Difficulty::Expert;
+    /// Answer requests from standard input, or from socket_path if set, until the input ends.
+    bool serve = false;
+    std::string socket_path;
+    /// Puzzle files or directories; - for standard input.
+    std::vector<std::string> inputs;
+};
+
+void printUsage(char const* executable)
+{
+    fmt::print("\nUsage: {0} [options] <input_file.txt>\n"
+               "       {0} --batch [options] <input>...\n"
+               "\nOptions:\n"
+               "  --strategy=<s>         Search strategy: dfs (default), astar, ida or anytime\n"
+               "  --weight=<w>           Heuristic weight for the astar and ida strategies (default: 2); 1 finds a shortest solution\n"
+               "  --threads=<n>          Number of threads for the dfs strategy; 0 uses all available cores\n"
+               "  --ordering=<o>         Order in which moves are tried: heuristic (default), history or size\n"
+               "  --canonical            Treat boards that only differ by the order of stacks and swaps as identical\n"
+               "  --no-dead-ends         Search boards without free space even if they are provably lost\n"
+               "  --shorten=<d>          Look for shortcuts of up to d moves in the solution found (default: 2)\n"
+               "  --no-shorten           Print the solution as found by the search\n"
+               "  --max-states-mb=<n>    Limit the memory used for remembering visited boards to n MiB (ida default: 16);\n"
+               "                         for astar, the limit for all of its storage (default: 1024)\n"
+               "  --no-prune[=<rules>]   Disable all or a comma-separated list of move pruning rules:\n"
+               "                         {1}\n"
+               "  --output=<mode>        What to print for a single puzzle: text (default), replay, moves, json or none\n"
+               "                         In all modes, the exit code is 0 if solved, 2 if unsolvable and 3 if the solver gave up\n"
+               "  --progress[=<ms>]      Print search statistics to stderr every ms milliseconds (default: 1000)\n"
+               "  --timeout-ms=<n>       Give up after n milliseconds\n"
+               "  --max-nodes=<n>        Give up after expanding n boards\n"
+               "  --max-memory=<n>       Give up once the search uses more than n MiB\n"
+               "  --cache=<file>         Look up deals in a solution cache file before solving, and store new results in it\n"
+               "  --endgame=<file>       Finish boards with few suits left using an endgame table\n"
+               "  --build-endgame=<file> Do not solve; build an endgame table and write it to file\n"
+               "  --endgame-suits=<k>    Number of suits left up to which --build-endgame covers boards, 1-{2} (default: {2})\n"
+               "\nBatch mode:\n"
+               "  --batch                Solve all puzzles from the given inputs and print one line per puzzle.\n"
+               "                         Inputs may be files containing any number of puzzles, directories,\n"
+               "                         or - for standard input.\n"
+               "  --file-list=<file>     Also solve the puzzles from all files listed in file, one per line\n"
+               "  --jobs=<n>             Number of puzzles solved in parallel; 0 (default) uses all available cores\n"
+               "  --out-format=<f>       Write results as text (default) or in the binary solution format (bin)\n"
+               "  --out-file=<file>      Write results to file instead of standard output\n"
+               "  --convert              Do not solve; write the puzzles themselves in the output format\n"
+               "  --generate=<n>         Also solve n random deals\n"
+               "  --seed=<s>             Seed for the random deals (default: 0)\n"
+               "  --difficulty=<d>       Difficulty of the random deals: easy, medium, hard, expert (default) or mixed\n"
+               "\n  --in-format=<f>        Read puzzles as text (default) or in the binary puzzle format (bin)\n"
+               "\nServer mode:\n"
+               "  --serve[=<socket>]     Answer requests from standard input, or from clients of a Unix domain socket.\n"
+               "                         Each request is a line '<id> <puzzle>', with the rows of the puzzle separated by ';'.\n"
+               "                         Each response is a line like in batch mode, starting with the id of the request,\n"
+               "                         written as soon as it is solved. --jobs sets the number of solver threads.\n",
+               executable, fmt::join(pruning_rule_names, ", "), EndgameTable::MaxLooseSuits);
+}
+
+std::optional<CommandLine> parseCommandLine(int argc, char* argv[])
+{
+    CommandLine ret;
+    ret.jobs = std::max(1u, std::thread::hardware_concurrency());
+    SolverOptions& options = ret.options;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view const arg = argv[i];
+        if (arg == "--canonical") {
+            options.canonicalize = true;
+        } else if (arg == "--no-dead-ends") {
+            options.detect_dead_ends = false;
+        } else if (arg.starts_with("--shorten=")) {
+            auto const depth = parseNumber<int>(arg.substr(arg.find('=') + 1));
+            if (!depth || (*depth < 0)) { return std::nullopt; }
+            options.shorten_solutions = true;
+            options.shorten_depth = *depth;
+        } else if (arg == "--no-shorten") {
+            options.shorten_solutions = false;
+        } else if (arg == "--ordering=size") {
+            options.move_ordering = MoveOrdering::Size;
+        } else if (arg == "--ordering=heuristic") {
+            options.move_ordering = MoveOrdering::Heuristic;
+        } else if (arg == "--ordering=history") {
+            options.move_ordering = MoveOrdering::History;
+        } else if (arg == "--strategy=dfs") {
+            options.strategy = SearchStrategy::DepthFirst;
+        } else if (arg == "--strategy=astar") {
+            options.strategy = SearchStrategy::AStar;
+        } else if (arg == "--strategy=ida") {
+            options.strategy = SearchStrategy::IterativeDeepening;
+        } else if (arg == "--strategy=anytime") {
+            options.strategy = SearchStrategy::Anytime;
+        } else if (arg.starts_with("--threads=")) {
+            auto const threads = parseNumber<std::size_t>(arg.substr(arg.find('=') + 1));
+            if (!threads) { return std::nullopt; }
+            options.threads = (*threads == 0) ? std::max(1u, std::thread::hardware_concurrency()) : *threads;
+        } else if (arg.starts_with("--weight=")) {
+            auto const weight = parseNumber<double>(arg.substr(arg.find('=') + 1));
+            if (!weight || (*weight < 1.0)) { return std::nullopt; }
+            options.heuristic_weight = *weight;
+        } else if (arg.starts_with("--max-states-mb=")) {
+            auto const mb = parseNumber<std::size_t>(arg.substr(arg.find('=') + 1));
+            if (!mb) { return std::nullopt; }
+            options.max_visited_bytes = *mb * 1024 * 1024;
+        } else if (arg == "--no-prune") {
+            options.pruning.fill(false);
+        } else if (arg.starts_with("--no-prune=")) {
+            for (auto const name : std::views::split(arg.substr(arg.find('=') + 1), ',')) {
+                auto const it = std::ranges::find(pruning_rule_names, std::string_view(name.begin(), name.end()));
+                if (it == end(pruning_rule_names)) { return std::nullopt; }
+                options.pruning[std::distance(begin(pruning_rule_names), it)] = false;
+            }
+        } else if (arg.starts_with("--output=")) {
+            std::string_view const mode = arg.substr(arg.find('=') + 1);
+            if (mode == "text") {
+                ret.output = OutputMode::Text;
+            } else if (mode == "replay") {
+                ret.output = OutputMode::Replay;
+            } else if (mode == "moves") {
+                ret.output = OutputMode::Moves;
+            } else if (mode == "json") {
+                ret.output = OutputMode::Json;
+            } else if (mode == "none") {
+                ret.output = OutputMode::None;
+            } else {
+                return std::nullopt;
+            }
+        } else if (arg.starts_with("--timeout-ms=")) {
+            auto const ms = parseNumber<std::uint64_t>(arg.substr(arg.find('=') + 1));
+            if (!ms) { return std::nullopt; }
+            options.time_limit = std::chrono::milliseconds(*ms);
+        } else if (arg.starts_with("--max-nodes=")) {
+            auto const nodes = parseNumber<std::uint64_t>(arg.substr(arg.find('=') + 1));
+            if (!nodes) { return std::nullopt; }
+            options.max_nodes = *nodes;
+        } else if (arg.starts_with("--max-memory=")) {
+            auto const mb = parseNumber<std::size_t>(arg.substr(arg.find('=') + 1));
+            if (!mb) { return std::nullopt; }
+            options.max_memory_bytes = *mb * 1024 * 1024;
+        } else if (arg == "--progress") {
+            ret.progress = true;
+        } else if (arg.starts_with("--progress=")) {
+            auto const ms = parseNumber<unsigned>(arg.substr(arg.find('=') + 1));
+            if (!ms || (*ms == 0)) { return std::nullopt; }
+            ret.progress = true;
+            options.progress_interval = std::chrono::milliseconds(*ms);
+        } else if (arg == "--batch") {
+            ret.batch = true;
+        } else if (arg.starts_with("--jobs=")) {
+            auto const jobs = parseNumber<std::size_t>(arg.substr(arg.find('=') + 1));
+            if (!jobs) { return std::nullopt; }
+            if (*jobs != 0) { ret.jobs = *jobs; }
+        } else if (arg.starts_with("--file-list=")) {
+            std::string const list_file(arg.substr(arg.find('=') + 1));
+            auto const list = MappedFile::open(list_file.c_str());
+            if (!list) { return std::nullopt; }
+            for (auto const line : std::views::split(list->getContents(), '\n')) {
+                std::string_view l(line.begin(), line.end());
+                while (!l.empty() && ((l.back() == '\r') || (l.back() == ' '))) { l.remove_suffix(1); }
+                if (!l.empty()) { ret.inputs.emplace_back(l); }
+            }
+        } else if ((arg == "--in-format=text") || (arg == "--in-format=bin")) {
+            ret.binary_input = arg.ends_with("bin");
+        } else if ((arg == "--out-format=text") || (arg == "--out-format=bin")) {
+            ret.binary_output = arg.ends_with("bin");
+        } else if (arg.starts_with("--cache=")) {
+            ret.cache_file = arg.substr(arg.find('=') + 1);
+            if (ret.cache_file.empty()) { return std::nullopt; }
+        } else if (arg.starts_with("--endgame=")) {
+            ret.endgame_file = arg.substr(arg.find('=') + 1);
+            if (ret.endgame_file.empty()) { return std::nullopt; }
+        } else if (arg.starts_with("--build-endgame=")) {
+            ret.endgame_file = arg.substr(arg.find('=') + 1);
+            if (ret.endgame_file.empty()) { return std::nullopt; }
+            ret.build_endgame = true;
+        } else if (arg.starts_with("--endgame-suits=")) {
+            auto const suits = parseNumber<int>(arg.substr(arg.find('=') + 1));
+            if (!suits || (*suits < 1) || (*suits > EndgameTable::MaxLooseSuits)) { return std::nullopt; }
+            ret.endgame_suits = *suits;
+        } else if (arg.starts_with("--out-file=")) {
+            ret.output_file = arg.substr(arg.find('=') + 1);
+            if (ret.output_file.empty()) { return std::nullopt; }
+        } else if (arg.starts_with("--generate=")) {
+            auto const n = parseNumber<std::uint64_t>(arg.substr(arg.find('=') + 1));
+            if (!n) { return std::nullopt; }
+            ret.generate = *n;
+        } else if (arg.starts_with("--seed=")) {
+            auto const seed = parseNumber<std::uint64_t>(arg.substr(arg.find('=') + 1));
+            if (!seed) { return std::nullopt; }
+            ret.seed = *seed;
+        } else if (arg.starts_with("--difficulty=")) {
+            std::string_view const d = arg.substr(arg.find('=') + 1);
+            if (d == "easy") {
+                ret.difficulty = Difficulty::Easy;
+            } else if (d == "medium") {
+                ret.difficulty = Difficulty::Normal;
+            } else if (d == "hard") {
+                ret.difficulty = Difficulty::Hard;
+            } else if (d == "expert") {
+                ret.difficulty = Difficulty::Expert;
+            } else if (d == "mixed") {
+                ret.difficulty = std::nullopt;
+            } else {
+                return std::nullopt;
+            }
+        } else if (arg == "--convert") {
+            ret.convert = true;
+        } else if (arg == "--serve") {
+            ret.serve = true;
+        } else if (arg.starts_with("--serve=")) {
+            ret.serve = true;
+            ret.socket_path = arg.substr(arg.find('=') + 1);
+            if (ret.socket_path.empty()) { return std::nullopt; }
+        } else if ((arg == "-") || !arg.starts_with("--")) {
+            ret.inputs.emplace_back(arg);
+        } else {
+            return std::nullopt;
+        }
+    }
+    if (ret.build_endgame) { return ret; }
+    if (ret.serve) {
+        if (!ret.inputs.empty() || ret.batch || ret.binary_input || ret.binary_output || ret.convert) { return std::nullopt; }
+        return ret;
+    }
+    if (ret.batch ? (ret.inputs.empty() && (ret.generate == 0)) : (ret.inputs.size() != 1)) { return std::nullopt; }
+    if (!ret.batch && (ret.binary_output || ret.convert || !ret.output_file.empty() || (ret.generate != 0))) {
+        return std::nullopt;
+    }
+    return ret;
+}
+
+/** Name of the status of a result, as used in the batch and JSON output.
+ */
+std::string_view getStatusName(SolveResult const& result)
+{
+    switch (result.status) {
+    case SolveStatus::Solved:       return "solved";
+    case SolveStatus::Unsolvable:   return "unsolvable";
+    default:                        return "gave-up";
+    }
+}
+
+std::string_view getLimitName(SearchLimit limit)
+{
+    switch (limit) {
+    case SearchLimit::Time:     return "time";
+    case SearchLimit::Nodes:    return "nodes";
+    case SearchLimit::Memory:   return "memory";
+    default:                    return "none";
+    }
+}
+
+/** Appends the search statistics in human-readable form.
+ */
+void formatStats(SearchStats const& stats, std::string& out)
+{
+    fmt::format_to(std::back_inserter(out),
+                   "nodes {} ({:.0f}/s), moves generated {}, duplicates {}, dead ends {}, endgame hits {}, peak depth {}, visited boards {} ({:.1f} MiB)",
+                   stats.nodes_expanded, stats.getNodesPerSecond(), stats.moves_generated, stats.duplicates,
+                   stats.dead_ends, stats.endgame_hits, stats.peak_depth, stats.peak_visited_boards, static_cast<double>(stats.peak_visited_bytes) / (1024 * 1024));
+}
+
+/** Returns a progress callback printing the statistics to stderr, prefixed with name.
+ */
+std::function<void(SearchStats const&)> makeProgressPrinter(std::string_view const* name)
+{
+    return [name](SearchStats const& stats) {
+        std::string line = fmt::format("{}[{:.1f}s] ", *name, std::chrono::duration<double>(stats.elapsed).count());
+        formatStats(stats, line);
+        line.push_back('\n');
+        std::fputs(line.c_str(), stderr);
+    };
+}
+
+/** Formats the result of solving a puzzle as a line of the batch output.
+ */
+std::string formatResultLine(std::string_view name, SolveResult const& result, std::chrono::steady_clock::duration solve_time)
+{
+    std::string line = fmt::format("{} {} {} {}", name, getStatusName(result), result.moves.size(),
+                                   std::chrono::duration_cast<std::chrono::milliseconds>(solve_time).count());
+    if (!result.moves.empty()) { fmt::format_to(std::back_inserter(line), " {:c}", fmt::join(result.moves, " ")); }
+    line.push_back('\n');
+    return line;
+}
+
+/** Appends the result of solving a puzzle as a JSON object.
+ */
+void formatJsonResult(SolveResult const& result, std::chrono::steady_clock::duration solve_time, std::string& out)
+{
+    auto it = std::back_inserter(out);
+    fmt::format_to(it, "{{\"status\":\"{}\",", getStatusName(result));
+    if (result.status == SolveStatus::GaveUp) { fmt::format_to(it, "\"exceeded_limit\":\"{}\",", getLimitName(result.exceeded_limit)); }
+    fmt::format_to(it, "\"from_cache\":{},\"time_ms\":{},\"moves\":[", result.from_cache,
+                   std::chrono::duration_cast<std::chrono::milliseconds>(solve_time).count());
+    bool first = true;
+    for (auto const& m : result.moves) {
+        fmt::format_to(it, "{}{{\"from\":{},\"to\":{},\"size\":{}}}", first ? "" : ",", m.from, m.to, m.size);
+        first = false;
+    }
+    SearchStats const& stats = result.stats;
+    fmt::format_to(it, "],\"stats\":{{\"nodes_expanded\":{},\"nodes_per_second\":{:.0f},\"moves_generated\":{},"
+                   "\"duplicates\":{},\"dead_ends\":{},\"endgame_hits\":{},\"moves_shortened\":{},\"peak_depth\":{},"
+                   "\"peak_visited_boards\":{},\"peak_visited_bytes\":{}}}",
+                   stats.nodes_expanded, stats.getNodesPerSecond(), stats.moves_generated, stats.duplicates,
+                   stats.dead_ends, stats.endgame_hits, stats.moves_shortened, stats.peak_depth, stats.peak_visited_boards,
+                   stats.peak_visited_bytes);
+    fmt::format_to(it, ",\"pruned_moves\":{{");
+    for (std::size_t i = 0; i < PruningRuleCount; ++i) {
+        fmt::format_to(it, "{}\"{}\":{}", (i == 0) ? "" : ",", pruning_rule_names[i], stats.pruning.removed_moves[i]);
+    }
+    fmt::format_to(it, "}}}}\n");
+}
+
+int solveSingle(CommandLine const& cmd)
+{
+    // only the human-readable modes talk to the user; the others only print results
+    bool const is_text = (cmd.output == OutputMode::Text) || (cmd.output == OutputMode::Replay);
+    std::FILE* const messages = is_text ? stdout : stderr;
+    if (is_text) { fmt::print("*** KABUFUDA SOLITAIRE ***\n"); }
+
+    char const* input_file = cmd.inputs.front().c_str();
+    auto const in = MappedFile::open(input_file);
+    if (!in) {
+        fmt::print(messages, "Error reading input file {}\n", input_file);
+        return 1;
+    }
+    Board b;
+    if (cmd.binary_input) {
+        // solve the first puzzle of the file
+        auto const records = getBinaryContents(in->getContents(), BinaryPuzzleMagic);
+        if (records && (records->size() >= BinaryPuzzleRecordSize)) {
+            b = decodeBinaryPuzzle(records->substr(0, BinaryPuzzleRecordSize));
+        }
+    } else {
+        b = parseBoard(in->getContents());
+    }
+    if (!b.isValid()) {
+        fmt::print(messages, "Input file {} does not contain a valid puzzle input.\n"
+                   "\nHere's what I got from that file:\n{}\n", input_file, b);
+        return 1;
+    }
+
+    if (is_text) { fmt::print("Puzzle input:\n{}\n", b); }
+
+    SolverOptions options = cmd.options;
+    std::string_view const progress_prefix;
+    if (cmd.progress) { options.progress = makeProgressPrinter(&progress_prefix); }
+    std::chrono::steady_clock::time_point t0;
+    if (options.strategy == SearchStrategy::Anytime) {
+        options.on_solution = [&t0, messages](std::vector<Move> const& solution) {
+            fmt::print(messages, "Found a solution with {} moves after {} ms.\n", solution.size(),
+                       std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count());
+            std::fflush(messages);
+        };
+    }
+    Solver solver(options);
+    t0 = std::chrono::steady_clock::now();
+    SolveResult const result = solver.solve(b);
+    auto const t1 = std::chrono::steady_clock::now();
+    auto const& moves = result.moves;
+    auto const& pruning_stats = result.stats.pruning;
+
+    // collect all output and write it at once
+    std::string out;
+    auto it = std::back_inserter(out);
+    switch (cmd.output) {
+    case OutputMode::Text:
+    case OutputMode::Replay:
+        if (result.status == SolveStatus::Unsolvable) {
+            fmt::format_to(it, "The puzzle has no solution. :(\n");
+        } else if (result.status == SolveStatus::GaveUp) {
+            fmt::format_to(it, "Gave up without finding a solution; the {} limit was exceeded.\n", getLimitName(result.exceeded_limit));
+        } else {
+            fmt::format_to(it, "!!! We have a winner !!!\n");
+            fmt::format_to(it, "*** Winning Moves: ***\n");
+            for (auto const m : moves) {
+                fmt::format_to(it, " - {}\n", m);
+            }
+            if (cmd.output == OutputMode::Replay) {
+                Board b2 = b;
+                fmt::format_to(it, "Board:\n{}\n", b2);
+                for (auto const m : moves) {
+                    b2.applyMove(m);
+                    fmt::format_to(it, "Moving {}:\n{}\n", m, b2);
+                }
+            }
+        }
+        if (result.from_cache) { fmt::format_to(it, "\nThe result was taken from the solution cache.\n"); }
+        if (result.stats.moves_shortened > 0) {
+            fmt::format_to(it, "\nThe solution was shortened by {} moves after the search.\n", result.stats.moves_shortened);
+        }
+        fmt::format_to(it, "\nSolving the puzzle took {} ms.\n",
+                       std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count());
+        fmt::format_to(it, "Search: ");
+        formatStats(result.stats, out);
+        fmt::format_to(it, "\n");
+        fmt::format_to(it, "Pruned moves:");
+        for (std::size_t i = 0; i < PruningRuleCount; ++i) {
+            fmt::format_to(it, " {} {}", pruning_rule_names[i], pruning_stats.removed_moves[i]);
+        }
+        fmt::format_to(it, "\n");
+        break;
+    case OutputMode::Moves:
+        for (auto const m : moves) {
+            fmt::format_to(it, "{:c}\n", m);
+        }
+        break;
+    case OutputMode::Json:
+        formatJsonResult(result, t1 - t0, out);
+        break;
+    case OutputMode::None:
+        break;
+    }
+    std::fwrite(out.data(), 1, out.size(), stdout);
+
+    switch (result.status) {
+    case SolveStatus::Solved:       return 0;
+    case SolveStatus::Unsolvable:   return 2;
+    default:                        return 3;
+    }
+}
+
+/** Solves all puzzles from all inputs on a pool of threads, one puzzle per thread at a time.
+ *
+ * For each puzzle, a line of the form
+ *   <input>:<index> <solved|unsolvable|gave-up|invalid> <number of moves> <milliseconds> <moves>...
+ * is written, with the moves formatted as from>to*size, or a binary solution record.
+ * Results are written in input order.
+ */
+int solveBatch(CommandLine const& cmd)
+{
+    // collect all files, expanding directories
+    std::vector<std::string> files;
+    for (auto const& in : cmd.inputs) {
+        std::error_code ec;
+        if (std::filesystem::is_directory(in, ec)) {
+            std::vector<std::string> dir_files;
+            for (auto const& entry : std::filesystem::directory_iterator(in, ec)) {
+                if (entry.is_regular_file()) { dir_files.push_back(entry.path().string()); }
+            }
+            std::ranges::sort(dir_files);
+            files.insert(files.end(), dir_files.begin(), dir_files.end());
+        } else {
+            files.push_back(in);
+        }
+    }
+
+    struct Puzzle {
+        std::string name;
+        std::string_view input;
+        /// Line number of the first line of input within its file; unused for binary input.
+        std::size_t first_line;
+        /// For random deals, the index passed to generateDeal(); input is empty in that case.
+        std::optional<std::uint64_t> deal_index;
+    };
+    std::vector<MappedFile> contents;
+    contents.reserve(files.size());
+    std::vector<Puzzle> puzzles;
+    int ret = 0;
+    for (auto const& f : files) {
+        std::optional<MappedFile> in = (f == "-") ? MappedFile::readStdin() : MappedFile::open(f.c_str());
+        if (!in) { ret = 1; continue; }
+        contents.push_back(std::move(*in));
+        std::string_view const file_contents = contents.back().getContents();
+        int index = 0;
+        if (cmd.binary_input) {
+            auto const records = getBinaryContents(file_contents, BinaryPuzzleMagic);
+            if (!records || (records->size() % BinaryPuzzleRecordSize != 0)) {
+                fmt::print(stderr, "{} is not a binary puzzle file.\n", f);
+                ret = 1;
+                continue;
+            }
+            for (std::size_t offset = 0; offset < records->size(); offset += BinaryPuzzleRecordSize) {
+                puzzles.push_back(Puzzle{ .name = fmt::format("{}:{}", f, ++index),
+                                          .input = records->substr(offset, BinaryPuzzleRecordSize), .first_line = 0,
+                                          .deal_index = std::nullopt });
+            }
+            continue;
+        }
+        std::size_t line = 1;
+        char const* counted_until = file_contents.data();
+        for (auto const p : splitPuzzles(file_contents)) {
+            line += static_cast<std::size_t>(std::count(counted_until, p.data(), '\n'));
+            counted_until = p.data();
+            puzzles.push_back(Puzzle{ .name = fmt::format("{}:{}", f, ++index), .input = p, .first_line = line,
+                                      .deal_index = std::nullopt });
+        }
+    }
+    for (std::uint64_t i = 0; i < cmd.generate; ++i) {
+        puzzles.push_back(Puzzle{ .name = fmt::format("seed-{}:{}", cmd.seed, i + 1), .input = {}, .first_line = 0,
+                                  .deal_index = i });
+    }
+
+    std::FILE* out = stdout;
+    if (!cmd.output_file.empty()) {
+        out = std::fopen(cmd.output_file.c_str(), (cmd.binary_output) ? "wb" : "w");
+        if (!out) {
+            fmt::print(stderr, "Unable to open output file '{}' for writing.\n", cmd.output_file);
+            return 1;
+        }
+    } else if (cmd.binary_output) {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    }
+    if (cmd.binary_output) {
+        std::string header;
+        writeBinaryHeader(cmd.convert ? BinaryPuzzleMagic : BinarySolutionMagic, header);
+        std::fwrite(header.data(), 1, header.size(), out);
+    }
+
+    std::vector<std::optional<std::string>> results(puzzles.size());
+    std::atomic<std::size_t> next_puzzle = 0;
+    std::mutex output_mutex;
+    std::size_t next_output = 0;
+    auto const worker = [&]() {
+        std::string progress_prefix;
+        std::string_view progress_prefix_view;
+        SolverOptions options = cmd.options;
+        if (cmd.progress) { options.progress = makeProgressPrinter(&progress_prefix_view); }
+        Solver solver(options);
+        for (std::size_t i = next_puzzle++; i < puzzles.size(); i = next_puzzle++) {
+            Puzzle const& p = puzzles[i];
+            progress_prefix = p.name + ' ';
+            progress_prefix_view = progress_prefix;
+            Board b;
+            if (p.deal_index) {
+                Difficulty const d = cmd.difficulty.value_or(static_cast<Difficulty>(*p.deal_index % 4));
+                b = generateDeal(cmd.seed, *p.deal_index, d);
+            } else if (cmd.binary_input) {
+                b = decodeBinaryPuzzle(p.input);
+                if (b.field[0].isEmpty()) { fmt::print(stderr, "{}: invalid puzzle record.\n", p.name); }
+            } else {
+                // lines are counted from 1, so line 0 means that no error occurred
+                ParseError error{ .line = 0, .column = 0, .message = {} };
+                b = parseBoard(p.input, &error);
+                if (error.line != 0) {
+                    fmt::print(stderr, "{}: line {}, column {}: {}.\n", p.name,
+                               p.first_line + error.line - 1, error.column, error.message);
+                }
+            }
+            bool const is_valid = !b.field[0].isEmpty() && b.isValid();
+            std::string result;
+            if (cmd.convert) {
+                if (is_valid) {
+                    if (cmd.binary_output) {
+                        encodeBinaryPuzzle(b, result);
+                    } else {
+                        formatPuzzleText(b, result);
+                        result.push_back('\n');
+                    }
+                }
+            } else if (!is_valid) {
+                if (cmd.binary_output) {
+                    encodeBinarySolution(BinarySolutionStatus::Invalid, {}, result);
+                } else {
+                    result = fmt::format("{} invalid 0 0\n", p.name);
+                }
+            } else {
+                auto const t0 = std::chrono::steady_clock::now();
+                SolveResult const solve_result = solver.solve(b);
+                auto const t1 = std::chrono::steady_clock::now();
+                if (cmd.binary_output) {
+                    constexpr std::array<BinarySolutionStatus, 3> binary_status = {
+                        BinarySolutionStatus::Solved, BinarySolutionStatus::Unsolvable, BinarySolutionStatus::GaveUp };
+                    encodeBinarySolution(binary_status[static_cast<std::size_t>(solve_result.status)], solve_result.moves, result);
+                } else {
+                    result = formatResultLine(p.name, solve_result, t1 - t0);
+                }
+            }
+            std::scoped_lock lk(output_mutex);
+            results[i] = std::move(result);
+            for (; (next_output < results.size()) && results[next_output]; ++next_output) {
+                std::fwrite(results[next_output]->data(), 1, results[next_output]->size(), out);
+                results[next_output].reset();
+            }
+            std::fflush(out);
+        }
+    };
+    {
+        std::vector<std::jthread> pool;
+        for (std::size_t i = 0; i < std::min(cmd.jobs, puzzles.size()); ++i) { pool.emplace_back(worker); }
+    }
+    if ((out != stdout) && (std::fclose(out) != 0)) {
+        fmt::print(stderr, "Error writing output file '{}'.\n", cmd.output_file);
+        ret = 1;
+    }
+    return ret;
+}
+
+/** Queue for passing items between threads.
+ */
+template<typename T>
+class BlockingQueue {
+    std::mutex mutex;
+    std::deque<T> items;
+    /// Counts the items, plus one once the queue has been closed.
+    std::counting_semaphore<> available{ 0 };
+public:
+    void push(T item)
+    {
+        {
+            std::scoped_lock lk(mutex);
+            items.push_back(std::move(item));
+        }
+        available.release();
+    }
+
+    /** Makes pop() return std::nullopt instead of waiting, once all items have been taken.
+     */
+    void close()
+    {
+        available.release();
+    }
+
+    /** Takes the oldest item, waiting for one if the queue is empty.
+     */
+    std::optional<T> pop()
+    {
+        available.acquire();
+        std::scoped_lock lk(mutex);
+        if (items.empty()) {
+            // the queue has been closed; pass that on to the next thread waiting
+            available.release();
+            return std::nullopt;
+        }
+        T ret = std::move(items.front());
+        items.pop_front();
+        return ret;
+    }
+};
+
+/** A client of the server mode.
+ *
+ * One thread reads the requests, and another one writes the responses in the order in which they are completed.
+ * The response queue is closed once the input has ended and all requests have been answered.
+ */
+class ServerConnection {
+    std::FILE* out;
+    BlockingQueue<std::string> responses;
+    std::mutex mutex;
+    std::size_t outstanding = 0;
+    bool reading = true;
+public:
+    explicit ServerConnection(std::FILE* output)
+        :out(output)
+    {}
+
+    ~ServerConnection()
+    {
+        if (out != stdout) { std::fclose(out); }
+    }
+
+    ServerConnection(ServerConnection const&) = delete;
+    ServerConnection& operator=(ServerConnection const&) = delete;
+
+    void beginRequest()
+    {
+        std::scoped_lock lk(mutex);
+        ++outstanding;
+    }
+
+    void respond(std::string response)
+    {
+        responses.push(std::move(response));
+        std::scoped_lock lk(mutex);
+        --outstanding;
+        if (!reading && (outstanding == 0)) { responses.close(); }
+    }
+
+    void endOfRequests()
+    {
+        std::scoped_lock lk(mutex);
+        reading = false;
+        if (outstanding == 0) { responses.close(); }
+    }
+
+    /** Writes responses until all requests have been answered.
+     */
+    void writeResponses()
+    {
+        while (auto const response = responses.pop()) {
+            // a client that went away does not stop the others, so write errors are ignored
+            std::fwrite(response->data(), 1, response->size(), out);
+            std::fflush(out);
+        }
+    }
+};
+
+struct ServerRequest {
+    std::shared_ptr<ServerConnection> connection;
+    std::string id;
+    Board board;
+};
+
+/** Reads a line without its line break.
+ * @return false if the input ended before anything was read.
+ */
+bool readLine(std::FILE* in, std::string& line)
+{
+    line.clear();
+    std::array<char, 256> chunk;
+    while (std::fgets(chunk.data(), static_cast<int>(chunk.size()), in)) {
+        line.append(chunk.data());
+        if (line.ends_with('\n')) {
+            line.pop_back();
+            return true;
+        }
+    }
+    return !line.empty();
+}
+
+/** Parses the requests of a connection and queues them for the solver threads.
+ * Invalid requests are answered right away.
+ */
+void readRequests(std::FILE* in, std::shared_ptr<ServerConnection> const& connection, BlockingQueue<ServerRequest>& requests)
+{
+    std::string line;
+    while (readLine(in, line)) {
+        std::string_view request(line);
+        while (!request.empty() && ((request.back() == '\r') || (request.back() == ' '))) { request.remove_suffix(1); }
+        while (!request.empty() && (request.front() == ' ')) { request.remove_prefix(1); }
+        if (request.empty()) { continue; }
+        std::size_t const id_end = std::min(request.find(' '), request.size());
+        std::string id(request.substr(0, id_end));
+        std::string puzzle(request.substr(id_end));
+        std::ranges::replace(puzzle, ';', '\n');
+        // lines are counted from 1, so line 0 means that no error occurred
+        ParseError error{ .line = 0, .column = 0, .message = {} };
+        Board b = parseBoard(puzzle, &error);
+        if (error.line != 0) {
+            fmt::print(stderr, "Request {}: row {}, column {}: {}.\n", id, error.line, error.column, error.message);
+        }
+        connection->beginRequest();
+        if (b.field[0].isEmpty() || !b.isValid()) {
+            connection->respond(fmt::format("{} invalid 0 0\n", id));
+        } else {
+            requests.push(ServerRequest{ .connection = connection, .id = std::move(id), .board = b });
+        }
+    }
+}
+
+/** Answers requests until the queue is closed. Each thread keeps its Solver, and with it the solver's tables, between requests.
+ */
+void solveRequests(SolverOptions const& options, BlockingQueue<ServerRequest>& requests)
+{
+    Solver solver(options);
+    while (auto request = requests.pop()) {
+        auto const t0 = std::chrono::steady_clock::now();
+        SolveResult const result = solver.solve(request->board);
+        auto const t1 = std::chrono::steady_clock::now();
+        request->connection->respond(formatResultLine(request->id, result, t1 - t0));
+    }
+}
+
+/** Runs a connection to the end of its input.
+ */
+void serveConnection(std::FILE* in, std::shared_ptr<ServerConnection> const& connection, BlockingQueue<ServerRequest>& requests)
+{
+    std::jthread writer([&connection]() { connection->writeResponses(); });
+    readRequests(in, connection, requests);
+    connection->endOfRequests();
+}
+
+int serve(CommandLine const& cmd)
+{
+    // shared with the connection threads, which may still be running when a listening server gives up
+    auto const requests = std::make_shared<BlockingQueue<ServerRequest>>();
+    std::vector<std::jthread> solvers;
+    for (std::size_t i = 0; i < cmd.jobs; ++i) {
+        solvers.emplace_back([&cmd, &requests]() { solveRequests(cmd.options, *requests); });
+    }
+    int ret = 0;
+    if (cmd.socket_path.empty()) {
+        serveConnection(stdin, std::make_shared<ServerConnection>(stdout), *requests);
+    } else {
+#ifdef _WIN32
+        fmt::print(stderr, "Serving on a socket is not supported on this platform.\n");
+        ret = 1;
+#else
+        int const listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if ((listener == -1) || (cmd.socket_path.size() >= sizeof(address.sun_path))) {
+            fmt::print(stderr, "Unable to create socket '{}'.\n", cmd.socket_path);
+            requests->close();
+            return 1;
+        }
+        std::memcpy(address.sun_path, cmd.socket_path.c_str(), cmd.socket_path.size() + 1);
+        // a socket file left behind by a previous server would make bind fail
+        ::unlink(cmd.socket_path.c_str());
+        if ((::bind(listener, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) != 0) ||
+            (::listen(listener, SOMAXCONN) != 0))
+        {
+            fmt::print(stderr, "Unable to listen on socket '{}': {}\n", cmd.socket_path, std::strerror(errno));
+            ::close(listener);
+            requests->close();
+            return 1;
+        }
+        // clients that disconnect early must not terminate the server
+        std::signal(SIGPIPE, SIG_IGN);
+        for (;;) {
+            int const fd = ::accept(listener, nullptr, nullptr);
+            if (fd == -1) {
+                int const error = errno;
+                if ((error == EBADF) || (error == EINVAL) || (error == ENOTSOCK)) {
+                    // the listener itself is broken
+                    fmt::print(stderr, "Unable to accept connections on socket '{}': {}\n", cmd.socket_path, std::strerror(error));
+                    ret = 1;
+                    break;
+                }
+                if ((error == EMFILE) || (error == ENFILE) || (error == ENOBUFS) || (error == ENOMEM)) {
+                    // out of resources for now; give the running connections a chance to release some
+                    fmt::print(stderr, "Unable to accept a connection on socket '{}': {}\n", cmd.socket_path, std::strerror(error));
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
+                // anything else, like a client resetting its connection before it was accepted, only affects that client
+                continue;
+            }
+            std::FILE* const in = ::fdopen(fd, "r");
+            int const out_fd = ::dup(fd);
+            std::FILE* const out = (out_fd == -1) ? nullptr : ::fdopen(out_fd, "w");
+            if (!in || !out) {
+                if (in) { std::fclose(in); } else { ::close(fd); }
+                if (out) { std::fclose(out); } else if (out_fd != -1) { ::close(out_fd); }
+                continue;
+            }
+            std::thread([in, connection = std::make_shared<ServerConnection>(out), requests]() {
+                    serveConnection(in, connection, *requests);
+                    std::fclose(in);
+                }).detach();
+        }
+        ::close(listener);
+#endif
+    }
+    requests->close();
+    return ret;
+}
+
+int main(int argc, char* argv[])
+{
+    auto cmd = parseCommandLine(argc, argv);
+    if (!cmd) {
+        fmt::print("*** KABUFUDA SOLITAIRE ***\n");
+        printUsage(argv[0]);
+        return 0;
+    }
+    if (cmd->build_endgame) {
+        auto const boards = EndgameTable::build(cmd->endgame_suits, cmd->endgame_file.c_str());
+        if (!boards) { return 1; }
+        fmt::print("Wrote endgame table '{}' with {} boards.\n", cmd->endgame_file, *boards);
+        return 0;
+    }
+    std::optional<EndgameTable> endgame;
+    if (!cmd->endgame_file.empty()) {
+        endgame = EndgameTable::open(cmd->endgame_file.c_str());
+        if (!endgame) { return 1; }
+        cmd->options.endgame = &*endgame;
+    }
+    std::optional<SolutionCache> cache;
+    if (!cmd->cache_file.empty()) {
+        cache = SolutionCache::open(cmd->cache_file.c_str());
+        if (!cache) { return 1; }
+        cmd->options.cache = &*cache;
+    }
+    if (cmd->serve) { return serve(*cmd); }
+    return cmd->batch ? solveBatch(*cmd) : solveSingle(*cmd);
+}
@@ -0,0 +1,224 @@
+/*
+Copyright (c) 2022 Andreas Weis (der_ghulbus@ghulbus-inc.de)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <kabufuda.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <string_view>
+#include <utility>
+
+/** Regression tests for the solver library.
+ * Run without arguments to execute all tests, or pass the name of a single test.
+ */
+
+namespace {
+
+int failed_checks = 0;
+
+void check(bool condition, char const* expression, char const* file, int line)
+{
+    if (!condition) {
+        fmt::print(stderr, "{}:{}: check failed: {}\n", file, line, expression);
+        ++failed_checks;
+    }
+}
+
+#define KABUFUDA_CHECK(...) check(static_cast<bool>(__VA_ARGS__), #__VA_ARGS__, __FILE__, __LINE__)
+
+/** Replays moves on a board and tests whether they win it.
+ */
+bool isWinningSequence(Board b, std::vector<Move> const& moves)
+{
+    for (auto const& m : moves) {
+        if (!moveIsValidForBoard(b, m)) { return false; }
+        b.applyMove(m);
+    }
+    return b.hasWon();
+}
+
+/** A run of four cards that is not collapsed, because it was uncovered instead of being built.
+ * With the only unlocked swap collapsed, moving the run onto the empty stack is the only way
+ * to finish the board in a single move.
+ */
+Board makeUncoveredRunBoard()
+{
+    Board b(Difficulty::Expert);
+    b.swaps[0].pushStack(Card{ 9 }, 4);
+    b.field[0] = CardStack{ Card{ 0 }, Card{ 0 }, Card{ 0 }, Card{ 0 } };
+    return b;
+}
+
+void testRunToEmptyKeepsCollapse()
+{
+    Board const b = makeUncoveredRunBoard();
+    MoveBuffer moves;
+    getAllValidMoves(b, moves);
+    PruningStats stats;
+    pruneMoves(b, moves, nullptr, AllPruningRules, stats);
+    Move const collapse{ .from = 0, .to = 1, .size = 4 };
+    KABUFUDA_CHECK(std::ranges::find(moves, collapse) != moves.end());
+}
+
+void testShortestSolutionWithUncoveredRun()
+{
+    Board const b = makeUncoveredRunBoard();
+    for (auto const strategy : { SearchStrategy::AStar, SearchStrategy::IterativeDeepening }) {
+        SolverOptions options;
+        options.strategy = strategy;
+        options.heuristic_weight = 1.0;
+        options.shorten_solutions = false;
+        SolveResult const result = Solver(options).solve(b);
+        KABUFUDA_CHECK(result.status == SolveStatus::Solved);
+        KABUFUDA_CHECK(result.moves.size() == 1);
+        KABUFUDA_CHECK(isWinningSequence(b, result.moves));
+    }
+}
+
+constexpr std::string_view sample_deal =
+    " 6   3   7   5   3   3   4   2\n"
+    " 1   7   6   0   4   5   0   5\n"
+    " 9   2   1   0   2   8   3   9\n"
+    " 6   8   7   2   8   9   4   1\n"
+    " 8   7   1   6   9   5   4   0\n"
+    "Hard\n";
+
+/** Cache file in the temporary directory that is removed when the test is done.
+ */
+struct TemporaryCacheFile {
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "kabufuda_test_cache.kbfc";
+
+    TemporaryCacheFile() {
+        std::filesystem::remove(path);
+    }
+
+    ~TemporaryCacheFile() {
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+};
+
+void testCacheFindsPermutedDeal()
+{
+    TemporaryCacheFile const file;
+    Board const b = parseBoard(sample_deal);
+    {
+        std::optional<SolutionCache> cache = SolutionCache::open(file.path.string().c_str());
+        KABUFUDA_CHECK(cache.has_value());
+        if (!cache) { return; }
+        SolverOptions options;
+        options.cache = &*cache;
+        SolveResult const result = Solver(options).solve(b);
+        KABUFUDA_CHECK(result.status == SolveStatus::Solved);
+        KABUFUDA_CHECK(!result.from_cache);
+        KABUFUDA_CHECK(cache->size() == 1);
+    }
+
+    // reopen the file, so that the record has to survive the round trip through the file
+    std::optional<SolutionCache> const cache = SolutionCache::open(file.path.string().c_str());
+    KABUFUDA_CHECK(cache.has_value() && (cache->size() == 1));
+    if (!cache) { return; }
+    Board permuted = b;
+    std::ranges::reverse(permuted.field);
+    std::swap(permuted.field[1], permuted.field[4]);
+    std::optional<SolveResult> const cached = cache->lookup(permuted);
+    KABUFUDA_CHECK(cached.has_value());
+    if (!cached) { return; }
+    KABUFUDA_CHECK(cached->from_cache);
+    KABUFUDA_CHECK(cached->status == SolveStatus::Solved);
+    KABUFUDA_CHECK(isWinningSequence(permuted, cached->moves));
+    std::optional<SolveResult> const original = cache->lookup(b);
+    KABUFUDA_CHECK(original.has_value() && isWinningSequence(b, original->moves));
+}
+
+void testCacheServesShortestSolutionsOnlyIfProven()
+{
+    TemporaryCacheFile const file;
+    Board const b = parseBoard(sample_deal);
+    std::optional<SolutionCache> cache = SolutionCache::open(file.path.string().c_str());
+    KABUFUDA_CHECK(cache.has_value());
+    if (!cache) { return; }
+
+    SolverOptions depth_first;
+    depth_first.cache = &*cache;
+    depth_first.shorten_solutions = false;
+    SolveResult const long_solution = Solver(depth_first).solve(b);
+    KABUFUDA_CHECK(long_solution.status == SolveStatus::Solved);
+    KABUFUDA_CHECK(!long_solution.is_shortest);
+
+    SolverOptions shortest;
+    shortest.cache = &*cache;
+    shortest.strategy = SearchStrategy::AStar;
+    shortest.heuristic_weight = 1.0;
+    SolveResult const short_solution = Solver(shortest).solve(b);
+    KABUFUDA_CHECK(short_solution.status == SolveStatus::Solved);
+    KABUFUDA_CHECK(!short_solution.from_cache);
+    KABUFUDA_CHECK(short_solution.is_shortest);
+    KABUFUDA_CHECK(short_solution.moves.size() < long_solution.moves.size());
+
+    // the shortest solution replaces the earlier one, also for the records read back from the file
+    cache.reset();
+    cache = SolutionCache::open(file.path.string().c_str());
+    KABUFUDA_CHECK(cache.has_value());
+    if (!cache) { return; }
+    shortest.cache = &*cache;
+    SolveResult const cached = Solver(shortest).solve(b);
+    KABUFUDA_CHECK(cached.from_cache);
+    KABUFUDA_CHECK(cached.is_shortest);
+    KABUFUDA_CHECK(cached.moves == short_solution.moves);
+}
+
+struct Test {
+    std::string_view name;
+    std::function<void()> run;
+};
+
+Test const tests[] = {
+    { "run_to_empty_keeps_collapse", testRunToEmptyKeepsCollapse },
+    { "shortest_solution_with_uncovered_run", testShortestSolutionWithUncoveredRun },
+    { "cache_finds_permuted_deal", testCacheFindsPermutedDeal },
+    { "cache_serves_shortest_solutions_only_if_proven", testCacheServesShortestSolutionsOnlyIfProven },
+};
+
+}
+
+int main(int argc, char* argv[])
+{
+    std::string_view const selected = (argc > 1) ? argv[1] : "";
+    bool found = false;
+    for (auto const& t : tests) {
+        if (!selected.empty() && (t.name != selected)) { continue; }
+        found = true;
+        int const failed_before = failed_checks;
+        t.run();
+        fmt::print("{}: {}\n", t.name, (failed_checks == failed_before) ? "passed" : "FAILED");
+    }
+    if (!found) {
+        fmt::print(stderr, "Unknown test '{}'.\n", selected);
+        return 1;
+    }
+    return (failed_checks == 0) ? 0 : 1;
+}